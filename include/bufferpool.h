@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+/*
+ * One block of storage that is handed out in pieces, for the RingBuffers of
+ * a whole scene.  Allocate() just bumps an index, and nothing is given back
+ * individually: Reset() drops everything at once.  The block only ever grows,
+ * so resetting a pool to the size it already has doesn't allocate.
+ *
+ * example:
+ * BufferPool<Position> pool;
+ * pool.Reset(4096); // one allocation
+ * Position* a = pool.Allocate(1024);
+ * Position* b = pool.Allocate(2048);
+ * pool.Allocate(2048); // nullptr, only 1024 left
+ * pool.Reset(4096); // no allocation, a and b are now invalid
+ */
+template<typename T>
+class BufferPool {
+ public:
+  BufferPool() : used_(0) {}
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  //returns nullptr when there isn't room for "size" more values
+  T* Allocate(size_t size) {
+    if (used_ + size > storage_.size()) return nullptr;
+    T* data = storage_.data() + used_;
+    used_ += size;
+    return data;
+  }
+
+  void Reset(size_t size) {
+    used_ = 0;
+    if (storage_.size() < size) storage_ = std::vector<T>(size);
+  }
+
+  size_t capacity() const { return storage_.size(); }
+  size_t used() const { return used_; }
+
+ private:
+  std::vector<T> storage_;
+  size_t used_;
+};
@@ -0,0 +1,44 @@
+//decimal.h
+#pragma once
+
+#include <cstddef>
+
+namespace pendulumNames {
+
+enum DecimalStatus {
+  kDecimalOk,
+  kDecimalMissing,      //no digits at all
+  kDecimalBadExponent,  //an 'e' without digits after it
+  kDecimalBadCharacter, //the number runs into a letter, '.' or '_'
+  kDecimalOutOfRange    //too big for a double
+};
+
+const char* DecimalStatusMessage(DecimalStatus status);
+
+//where the number ends, or where the problem is when status isn't kDecimalOk
+struct DecimalResult {
+  const char* end;
+  DecimalStatus status;
+};
+
+/*
+ * Reads a decimal number, [+-]digits[.digits][e[+-]digits] (either side of
+ * the '.' may be empty, but not both), from the start of [begin, end).  It
+ * doesn't need a '\0' at the end, and doesn't care about the locale.
+ *
+ * The result is correctly rounded: when the digits fit in 53 bits and the
+ * exponent is small, the power of ten is exact too, so one multiplication or
+ * division (which rounds correctly) gives the closest double.  That covers
+ * everything a person would write in a .harm file.  Anything else is handed
+ * to strtod.
+ *
+ * example:
+ * const char text[] = "12.5e-1, 3";
+ * double d;
+ * DecimalResult result = ParseDecimal(text, text + sizeof(text) - 1, d);
+ * // d == 1.25, result.end points at the ','
+ * result = ParseDecimal(text + 8, text + 8, d); // kDecimalMissing
+ */
+DecimalResult ParseDecimal(const char* begin, const char* end, double& d);
+
+}; //namespace pendulumNames
@@ -0,0 +1,175 @@
+//editor_channel.h
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vimserverNames {
+using std::string;
+using std::vector;
+
+//the editor is told where the channel is through the environment
+const char kChannelVariable[] = "HARMONOGRAM_CHANNEL";
+
+/*
+ * Just enough JSON for vim's channel messages: numbers, strings and arrays.
+ * Anything else (true, null, a dictionary...) is kept as the text it was.
+ *
+ * example:
+ * JsonValue message;
+ * ParseJson(text.data(), text.data() + text.size(), message);
+ * //["expr","line('.')",-1]
+ * message.items[1].text; //line('.')
+ */
+struct JsonValue {
+  enum Kind { kNumber, kString, kArray, kOther };
+  Kind kind = kOther;
+  //a string's characters, unescaped, or a number's (or other's) text
+  string text;
+  vector<JsonValue> items;
+};
+
+//quoted and escaped
+string JsonQuote(const string& s);
+//a vim string, in single quotes, in which only the quotes are special
+string VimString(const string& s);
+//the end of the value that starts at begin, null if it isn't all there yet
+const char* JsonValueEnd(const char* begin, const char* end);
+//false if [begin, end) isn't one value
+bool ParseJson(const char* begin, const char* end, JsonValue& value);
+
+/*
+ * A connected stream socket with whole JSON values going both ways, as vim's
+ * channel has them: one after the other, whatever is in between ignored.
+ * JsonSockets can be moved but not copied, the socket is closed with the last
+ * one.
+ *
+ * example:
+ * JsonSocket socket = ConnectChannel("/tmp/harmonogram.sock");
+ * socket.Send("[-1,\"n\"]");
+ * JsonValue message;
+ * while (socket.Receive(message, 1)) Answer(message);
+ */
+class JsonSocket {
+ public:
+  JsonSocket() : fd_(-1) {}
+  explicit JsonSocket(int fd) : fd_(fd) {}
+  JsonSocket(JsonSocket&& other);
+  JsonSocket& operator=(JsonSocket&& other);
+  JsonSocket(const JsonSocket&) = delete;
+  JsonSocket& operator=(const JsonSocket&) = delete;
+  ~JsonSocket() { Close(); }
+
+  bool good() const { return fd_ >= 0; }
+  void Close();
+  //false, and closed, if the other end is gone
+  bool Send(const string& message);
+  //the next message, false if none came within timeout (in seconds) or the
+  //other end is gone (then it is closed)
+  bool Receive(JsonValue& message, double timeout);
+
+ private:
+  int fd_;
+  //what has been read, but isn't a whole message yet
+  string buffer_;
+};
+
+//the editor's end, not good() if nothing is listening at path
+JsonSocket ConnectChannel(const string& path);
+
+/*
+ * Expressions and commands to be sent to vim together, as one expression: a
+ * list of the expressions, with the commands as execute()s, which vim
+ * evaluates in order.  Each one's value is at the index it was given, a
+ * command's is what it printed.  However many redraws are asked for, there is
+ * one, at the end.  If any of it fails, all of it does, as vim gives "ERROR"
+ * for the whole list.
+ *
+ * example:
+ * EditorBatch batch;
+ * size_t id = batch.Expr("matchadd('reverse', 'p1')");
+ * batch.Ex("call matchdelete(4)");
+ * batch.Redraw();
+ * JsonValue results;
+ * if (channel.Run(batch, results)) cout << results.items[id].text << endl;
+ */
+class EditorBatch {
+ public:
+  //the index of its value
+  size_t Expr(const string& expression);
+  size_t Ex(const string& command);
+  void Redraw() { redraw_ = true; }
+  void Clear();
+
+  bool empty() const { return items_.empty() && !redraw_; }
+  //how many values vim gives back for it, the redraw's included
+  size_t size() const { return items_.size() + (redraw_ ? 1 : 0); }
+  //only commands, so nothing needs to be waited for
+  bool Silent() const { return expressions_ == 0; }
+  string Expression() const;
+
+ private:
+  vector<string> items_;
+  size_t expressions_ = 0;
+  bool redraw_ = false;
+};
+
+/*
+ * Harmonogram's end of a channel to vim (see :help channel), over a unix
+ * socket, which vim connects to with ch_open("unix:" . path, {"mode":
+ * "json"}).  Expr() sends ["expr", expression, id] and waits for [id, result]:
+ * the ids are negative, as vim's channel wants from a server, and tell the
+ * answers apart from anything vim sends on its own, or an answer that came
+ * too late.  Ex(), Normal() and Redraw() don't wait for anything.  Run()
+ * sends an EditorBatch as one Expr(), or without waiting if it has nothing
+ * but commands.
+ *
+ * It is safe to use from any thread, one request at a time.
+ *
+ * example:
+ * EditorChannel channel;
+ * channel.Listen("/tmp/harmonogram.sock");
+ * MySystemCall("gvim -c 'call ch_open(...)'"); //or elf/mockeditor
+ * channel.Accept(5);
+ * JsonValue line;
+ * if (channel.Expr("line('.')", line)) cout << line.text << endl;
+ * channel.Ex("edit examples/input");
+ */
+class EditorChannel {
+ public:
+  EditorChannel() : listener_(-1), nextId_(0) {}
+  EditorChannel(const EditorChannel&) = delete;
+  EditorChannel& operator=(const EditorChannel&) = delete;
+  ~EditorChannel();
+
+  //replaces whatever was at path
+  bool Listen(const string& path);
+  //waits for the editor to connect, in place of the one there was
+  bool Accept(double timeout);
+  bool Connected();
+  //stops listening, and removes the socket's file
+  void Close();
+  const string& Path() const { return path_; }
+
+  //false if there was no answer within timeout, or vim's answer was "ERROR"
+  bool Expr(const string& expression, JsonValue& result, double timeout = 1);
+  //results is the list of the batch's values, empty if it was Silent(), and
+  //false if vim's answer isn't a list of as many
+  bool Run(const EditorBatch& batch, JsonValue& results, double timeout = 1);
+  bool Ex(const string& command);
+  bool Normal(const string& keys);
+  bool Redraw();
+
+ private:
+  bool Send(const string& message);
+
+  std::mutex mutex_;
+  int listener_;
+  JsonSocket socket_;
+  string path_;
+  int nextId_;
+};
+
+}; //namespace vimserverNames
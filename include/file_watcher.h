@@ -0,0 +1,49 @@
+//file_watcher.h
+#pragma once
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Watches a list of files with inotify, on a thread of its own, and calls
+ * changed(i) (on that thread) when the i-th file has been written.  The
+ * directories are watched rather than the files, since a lot of editors save
+ * by writing a new file and renaming it over the old one.
+ *
+ * Saving tends to come as a burst of events, so they are collected until
+ * things have been quiet for a little while, and each file is reported once.
+ *
+ * example:
+ * FileWatcher watcher({"examples/input"}, [](size_t i) {
+ *   cout << "file " << i << " changed" << endl;
+ * });
+ * if (!watcher.good()) cout << "not watching" << endl;
+ */
+class FileWatcher {
+ public:
+  FileWatcher(const std::vector<std::string>& fileNames,
+      std::function<void(size_t)> changed);
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+  ~FileWatcher();
+
+  bool good() const { return inotify_ >= 0; }
+
+ private:
+  struct WatchedFile {
+    int directory; //the inotify watch descriptor
+    std::string name; //without the directory
+  };
+
+  void Watch();
+  //the files named by the events in buffer
+  void Collect(const char* buffer, size_t size, std::vector<bool>& changed);
+
+  std::vector<WatchedFile> files_;
+  std::function<void(size_t)> changed_;
+  int inotify_;
+  int stopPipe_[2];
+  std::thread thread_;
+};
@@ -0,0 +1,89 @@
+//latest_worker.h
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mailbox.h"
+
+/*
+ * A thread of its own for work whose newest request is the only one that
+ * matters, e.g. asking the editor where its cursor is.  Post() never waits: a
+ * task that hasn't been started yet is replaced by the next one (and counted
+ * in dropped()), so however fast they come, the worker is never more than one
+ * behind.  The results go into a Mailbox, for the UI thread to pick up when
+ * it's ready.  The destructor waits for the task that is running, if any,
+ * and drops the one waiting.
+ *
+ * example:
+ * LatestWorker<Location> cursor;
+ * //on every key press
+ * cursor.Post([&]() { Location l; vimServer.GetCursor(l); return l; });
+ * //on every frame
+ * for (const Location& l : cursor.TakeAll()) Highlight(l);
+ */
+template<typename Result>
+class LatestWorker {
+ public:
+  LatestWorker() : pending_(false), stopping_(false), dropped_(0),
+      thread_(&LatestWorker::Work, this) {}
+  LatestWorker(const LatestWorker&) = delete;
+  LatestWorker& operator=(const LatestWorker&) = delete;
+  ~LatestWorker() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+
+  void Post(std::function<Result()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_) ++dropped_;
+      task_ = std::move(task);
+      pending_ = true;
+    }
+    wake_.notify_one();
+  }
+
+  //in the order they were finished
+  std::vector<Result> TakeAll() { return results_.TakeAll(); }
+
+  //the tasks that were replaced before they were started
+  size_t dropped() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+  }
+
+ private:
+  void Work() {
+    while (true) {
+      std::function<Result()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this]() { return pending_ || stopping_; });
+        if (stopping_) return;
+        task.swap(task_);
+        pending_ = false;
+      }
+      results_.Post(task());
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::function<Result()> task_;
+  bool pending_;
+  bool stopping_;
+  size_t dropped_;
+  Mailbox<Result> results_;
+  //last, so that everything is there before it starts
+  std::thread thread_;
+};
@@ -0,0 +1,116 @@
+//lexer.h
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <list>
+#include <string>
+#include <utility>
+
+#include "decimal.h"
+
+namespace pendulumNames {
+using std::list;
+using std::pair;
+using std::string;
+
+//Token stuff
+enum TokenName {
+  kTokAmplitude,
+  kTokCenter,
+  kTokColor,
+  kTokComma,
+  kTokCommentBegin,
+  kTokCommentEnd,
+  kTokCycles,
+  kTokDirection,
+  kTokFrequency,
+  kTokInvalid,
+  kTokName,
+  kTokOscillation,
+  kTokPendulumBegin,
+  kTokPendulumEnd,
+  kTokRotation,
+  kTokStartPhase,
+  kTokType
+};
+
+//every token but kTokInvalid, with how it is spelled (in lower case)
+const list<pair<TokenName, string>>& GetTokenList();
+
+/*
+ * A piece of a buffer that is owned by someone else (e.g. a MappedFile), so
+ * that a token can be looked at without copying it into a string.
+ */
+struct StringSlice {
+  const char* data;
+  size_t size;
+
+  const char* begin() const { return data; }
+  const char* end() const { return data + size; }
+  bool empty() const { return size == 0; }
+  string ToString() const { return string(data, size); }
+};
+
+//the token spelled like slice, ignoring case, or kTokInvalid
+TokenName SliceToTokenName(const StringSlice& slice);
+
+/*
+ * Scans a .harm file in place.  Next() skips to the next token and returns
+ * which one it was: whatever is in between is ignored (as the Trie used to),
+ * and the tokens are matched ignoring case.  The tokens are the Trie compiled
+ * into a TokenDfa, so this is one table lookup per byte.  The values are read
+ * with ReadDouble() and ReadIdentifier(), which skip white space first.
+ *
+ * Offset() is the place it has read up to, which is just after the last token
+ * or value.  Lines and columns aren't kept track of, a Location works them out
+ * from the offset if they are needed.
+ *
+ * example:
+ * MappedFile file("examples/input");
+ * Lexer lexer(file.begin(), file.end());
+ * double x;
+ * while (lexer.Next() != kTokInvalid) {
+ *   if (lexer.Token() == kTokFrequency && !lexer.ReadDouble(x)) ...
+ *   if (lexer.Token() == kTokName) cout << lexer.ReadIdentifier().ToString();
+ * }
+ */
+class Lexer {
+ public:
+  Lexer() : Lexer(nullptr, nullptr) {}
+  Lexer(const char* begin, const char* end);
+
+  //kTokInvalid when there are no more tokens
+  TokenName Next();
+  /*
+   * false when there is no well formed number here: the lexer is then left
+   * where the problem is, and NumberStatus() says what it is
+   */
+  bool ReadDouble(double& d);
+  //the letters and digits here, possibly none
+  StringSlice ReadIdentifier();
+
+  //Next() has run out of input
+  bool AtEnd() const { return atEnd_; }
+  DecimalStatus NumberStatus() const { return numberStatus_; }
+  TokenName Token() const { return token_; }
+  StringSlice TokenText() const { return tokenText_; }
+  size_t Offset() const { return cur_ - begin_; }
+  //the text between two offsets
+  StringSlice Text(size_t from, size_t to) const {
+    return StringSlice{begin_ + from, to - from};
+  }
+
+ private:
+  void SkipSpace();
+
+  const char* begin_;
+  const char* cur_;
+  const char* end_;
+  bool atEnd_;
+  DecimalStatus numberStatus_;
+  TokenName token_;
+  StringSlice tokenText_;
+};
+
+}; //namespace pendulumNames
@@ -1,17 +1,43 @@
 //location.h
 #pragma once
 
-#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef uint32_t FileId;
+const FileId kNoFile = (FileId)-1;
 
+/*
+ * A place in a source file: the file's id in the SourceRegistry and how many
+ * bytes into it.  That's all the parser has to keep; the line and column are
+ * worked out (by a binary search over the file's line starts) only when
+ * something asks for them, e.g. to print a diagnostic or move vim's cursor.
+ * Locations in different files aren't ordered, so neither <= the other.
+ *
+ * example:
+ * Location location{Sources().Register("examples/input"), 120};
+ * cout << location.ToString(); //examples/input:9:3
+ */
 struct Location {
-  std::string fileName;
-  size_t line;
-  size_t column;
+  FileId file = kNoFile;
+  size_t offset = 0;
 
-  void Reset();
+  const std::string& FileName() const;
+  //from 1, 0 if the file can't be read
+  size_t Line() const;
+  size_t Column() const;
   std::string ToString() const;
+  bool Valid() const { return file != kNoFile; }
   bool operator<=(const Location& rhs) const;
+  bool operator==(const Location& rhs) const {
+    return file == rhs.file && offset == rhs.offset;
+  }
 };
 
 class Range {
@@ -24,7 +50,60 @@ class Range {
   std::list<size_t> Lines() const;
   std::string ToString() const;
   bool Valid() const;
+  //by file, then begin, then end
   bool operator<(const Range& rhs) const;
 };
 
+/*
+ * The source files that Locations point into.  Every file name is stored
+ * once, under a FileId which stays the same for as long as the program runs,
+ * however many times the file is read.
+ *
+ * A file's line starts are found the first time they are needed, from the
+ * text if whoever is reading the file hands it over with IndexLines(), or else
+ * from the file as it is on disk.  Register() forgets them, since the file is
+ * about to be read again and may have changed.  All of it is safe to use from
+ * any thread.
+ *
+ * example:
+ * FileId file = Sources().Register("examples/input");
+ * Sources().IndexLines(file, text.begin(), text.end());
+ * Sources().Line(file, 120); //9
+ * Sources().Offset(file, 9, 3); //120, from vim's cursor back to a Location
+ */
+class SourceRegistry {
+ public:
+  FileId Register(const std::string& fileName);
+  //kNoFile if it was never registered
+  FileId Find(const std::string& fileName) const;
+  const std::string& FileName(FileId file) const;
+
+  //unless it is already known
+  void IndexLines(FileId file, const char* begin, const char* end);
+  //the offsets at which the lines start, empty if the file can't be read
+  std::vector<size_t> LineStarts(FileId file);
+  void SetLineStarts(FileId file, std::vector<size_t> lineStarts);
+
+  size_t Line(FileId file, size_t offset);
+  size_t Column(FileId file, size_t offset);
+  //the other way around, line and column from 1
+  size_t Offset(FileId file, size_t line, size_t column);
+
+ private:
+  struct Source {
+    std::string fileName;
+    bool indexed;
+    std::vector<size_t> lineStarts;
+  };
+
+  //with the lock held
+  Source& Indexed(FileId file);
+
+  mutable std::mutex mutex_;
+  //a deque, so that FileName() can hand out references
+  std::deque<Source> sources_;
+  std::unordered_map<std::string, FileId> ids_;
+};
 
+//the one registry, for the whole program
+SourceRegistry& Sources();
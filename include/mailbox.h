@@ -0,0 +1,48 @@
+//mailbox.h
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*
+ * Hands values from any number of threads to one that checks for them now
+ * and then (e.g. the UI thread, on its timer).  Checking an empty Mailbox
+ * doesn't take the lock, so it can be done on every tick.
+ *
+ * example:
+ * Mailbox<ParsedFile> reloads;
+ * //on a worker thread
+ * reloads.Post(ParseFile(name, timeDelta));
+ * //on the UI thread
+ * for (ParsedFile& file : reloads.TakeAll()) Apply(file);
+ */
+template<typename T>
+class Mailbox {
+ public:
+  Mailbox() : count_(0) {}
+
+  void Post(T value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    values_.push_back(std::move(value));
+    count_.store(values_.size(), std::memory_order_release);
+  }
+
+  //in the order they were posted
+  std::vector<T> TakeAll() {
+    std::vector<T> taken;
+    if (count_.load(std::memory_order_acquire) == 0) return taken;
+    std::lock_guard<std::mutex> lock(mutex_);
+    taken.swap(values_);
+    count_.store(0, std::memory_order_release);
+    return taken;
+  }
+
+  bool empty() const { return count_.load(std::memory_order_acquire) == 0; }
+
+ private:
+  std::mutex mutex_;
+  std::vector<T> values_;
+  std::atomic<size_t> count_;
+};
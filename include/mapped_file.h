@@ -0,0 +1,47 @@
+//mapped_file.h
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*
+ * A whole file, mapped read only into memory, so that it can be scanned in
+ * place instead of being copied through an istream.  An empty file is good()
+ * and has begin() == end().  MappedFiles can be moved but not copied, the
+ * mapping goes away with the last one.
+ *
+ * The pages that have been read stay in memory until the file is unmapped,
+ * unless they are given back with Release(), so that a file much bigger than
+ * the memory can be read in one pass.
+ *
+ * example:
+ * MappedFile file("examples/input");
+ * if (!file.good()) cout << "couldn't open file" << endl;
+ * Lexer lexer(file.begin(), file.end());
+ */
+class MappedFile {
+ public:
+  MappedFile() : data_(nullptr), size_(0), released_(0), good_(false) {}
+  explicit MappedFile(const std::string& fileName);
+  MappedFile(MappedFile&& other);
+  MappedFile& operator=(MappedFile&& other);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  bool good() const { return good_; }
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + size_; }
+  size_t size() const { return size_; }
+  //the whole pages before offset won't be read again
+  void Release(size_t offset);
+
+ private:
+  void Unmap();
+
+  const char* data_;
+  size_t size_;
+  //the pages before this have been given back
+  size_t released_;
+  bool good_;
+};
@@ -5,10 +5,12 @@
 #include <list>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace pendulumNames {
 using std::list;
 using std::string;
+using std::vector;
 
 struct Position {
   double x;
@@ -50,14 +52,13 @@ class PendulumBase {
   Position center;
   string name;
   Position position;
-  size_t preferredBufferSize;
+  size_t preferredBufferSize = 0;
 
   static double timeDelta;
 
   virtual double GetCycles() const = 0;
   virtual void UpdatePosition() = 0;
   virtual string ToString() const = 0;
-  virtual void SetPreferredBufferSize() = 0;
   /*
    * The following functions are here because of design errors.  Originally,
    * what is now "SimplePendulum" and "CompoundPendulum" were completely
@@ -85,28 +86,27 @@ class SimplePendulum : public PendulumBase {
   double GetCycles() const override;
   double GetPeriod() const;
   bool IsValid() const override;
-  void SetPreferredBufferSize();
+  //for a trail drawn timeDelta at a time, which is passed in rather than
+  //read, as the parser's threads can't look at the one the UI changes
+  void SetPreferredBufferSize(double timeDelta);
   string ToString() const override;
   void UpdatePosition() override;
   double WaveLength() const;
 };
 
- class HarmonogramParser;
-
 class CompoundPendulum : public PendulumBase {
  public:
   void AddPendulum(PendulumBase* p) { pendulumList_.push_back(p); }
+  void ClearPendulums() { pendulumList_.clear(); }
   double GetCycles() const override;
   bool IsValid() const override;
   void SetPreferredBufferSize();
   string ToString() const override;
   void UpdatePosition() override;
 
-  friend list<PendulumPtr> ReadCurrentInput(HarmonogramParser& parser);
-
-  double cycles_;
+  double cycles_ = 0;
  private:
-  list<PendulumBase*> pendulumList_;
+  vector<PendulumBase*> pendulumList_;
 };
 
 //returns the amount shifted
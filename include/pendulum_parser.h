@@ -1,56 +1,241 @@
 //pendulum_parser.h
 #pragma once
 
-#include <fstream>
+#include <cstdint>
+#include <future>
 #include <iostream>
 #include <list>
 #include <map>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <vector>
 
+#include "lexer.h"
 #include "location.h"
+#include "mapped_file.h"
 #include "pendulum.h"
-#include "trie.h"
+#include "scene.h"
+#include "thread_pool.h"
 
 namespace pendulumNames {
 using std::cout;
 using std::endl;
-using std::ifstream;
-using std::istream;
+using std::future;
 using std::list;
 using std::map;
 using std::move;
+using std::ostringstream;
 using std::pair;
 using std::string;
 using std::unique_ptr;
+using std::vector;
 
 const string kServerName = "PendulumServer";
 typedef string PendulumId;
 
-class HarmonogramParser {
+//something wrong with the input, and where it is
+struct Diagnostic {
+  Location location;
+  string message;
+  //from 1, as the parser counted them; 0 to have the location work them out
+  size_t line = 0;
+  size_t column = 0;
+
+  //file:line:column: message, as compilers (and vim's quickfix) have it
+  string ToString() const;
+};
+
+//one for each of the compounds scene.Link() couldn't order, where they are
+vector<Diagnostic> CycleDiagnostics(const Scene& scene,
+    const map<PendulumId, Range>& locationMap);
+
+/*
+ * Gets the pendulums of a file one at a time, as they are read, so that they
+ * can be dealt with and let go (drawn, converted, checked...) without ever
+ * having the whole file in memory.  The SimplePendulums come as soon as their
+ * '}' is read.  The file's CompoundPendulum comes last, and is made of the
+ * "children" SimplePendulums that came just before it.
+ *
+ * example:
+ * class Counter : public PendulumSink {
+ *  public:
+ *   void OnPendulum(SimplePendulum pendulum, const Range& range,
+ *       uint64_t blockHash) override { ++count; }
+ *   void OnCompound(CompoundPendulum compound, size_t children,
+ *       const Range& range, uint64_t blockHash) override {}
+ *   size_t count = 0;
+ * };
+ * Counter counter;
+ * FileParser("huge.harm", PendulumBase::timeDelta).Parse(counter);
+ */
+class PendulumSink {
  public:
+  virtual ~PendulumSink() {}
+  virtual void OnPendulum(SimplePendulum pendulum, const Range& range,
+      uint64_t blockHash) = 0;
+  virtual void OnCompound(CompoundPendulum compound, size_t children,
+      const Range& range, uint64_t blockHash) = 0;
+};
 
-  HarmonogramParser();
+/*
+ * Everything needed to read one file, so that files can be read at the same
+ * time.  Parse() adds the file's pendulums to the scene (without linking it),
+ * and their ranges to locationMap.  What would be printed along the way goes
+ * to log instead.  A scene file compiled by harmc is loaded as it is (see
+ * scene_file.h), in place of being parsed.
+ *
+ * The text can also be given as it is, in memory, under a name that stands for
+ * the file's in the diagnostics and locationMap, e.g. by a scene generator.
+ * It has to stay put until Parse() is done.
+ *
+ * The pendulums' buffer sizes are worked out for the timeDelta it is given,
+ * which the thread that makes it should read, as the UI changes
+ * PendulumBase::timeDelta (to stop time) while files are being parsed.
+ *
+ * Parse() can also hand the pendulums to a PendulumSink instead, which keeps
+ * nothing but the diagnostics, and gives back the pages of the file it is
+ * done with as it goes: the memory it needs doesn't grow with the file.  A
+ * scene file can't be read a piece at a time, so it is loaded whole, then
+ * handed over in the same way.
+ *
+ * Errors don't stop the parse.  Error() adds a Diagnostic, after which Good()
+ * is false and Advance() does nothing, so that whatever was being read gives
+ * up.  The pendulum it was in is dropped, and Recover() skips ahead to the
+ * next '{' to carry on from there.  Only the first error of each stretch is
+ * reported, the rest are likely to follow from it.
+ *
+ * example:
+ * FileParser parser("examples/input", PendulumBase::timeDelta);
+ * Scene scene;
+ * if (!parser.Parse(scene)) cout << "couldn't open file" << endl;
+ * cout << parser.log.str();
+ * for (const auto& d : parser.diagnostics) cout << d.ToString() << endl;
+ *
+ * string text = "{ name: p1 center: 1, 2 ... }";
+ * FileParser("generated/1", StringSlice{text.data(), text.size()},
+ *     PendulumBase::timeDelta).Parse(scene);
+ */
+class FileParser {
+ public:
+  FileParser(const string& fileName, double timeDelta);
+  FileParser(const string& name, StringSlice text, double timeDelta);
 
-  list<PendulumPtr> Parse(const list<string>& fileNameList);
+  //false if the file couldn't be opened (a buffer always can)
+  bool Parse(Scene& scene);
+  bool Parse(PendulumSink& sink);
 
   bool Advance();
-  void Error(const string& function, const string& message);
+  void Error(const string& message);
+  //after an Error(), skips to the next '{' (or the end), false if no Error()
+  bool Recover();
+  //an Error() since the last Recover()
+  bool Failed() const { return failed_; }
+  //the text before the lexer won't be looked at again
+  void Release();
   string GetCursor();
-  Location GetLocation() { return location_; }
-  istream& GetStream() { return *input_; }
-  string GetToken() { return trie_.GetToken(); }
-  bool Good() { return input_->good(); }
+  Location GetLocation();
+  Lexer& GetLexer() { return lexer_; }
+  TokenName GetToken() { return lexer_.Token(); }
+  bool Good() { return !lexer_.AtEnd() && !failed_; }
+  double TimeDelta() const { return timeDelta_; }
+
+  map<PendulumId, Range> locationMap;
+  //identifies the text that defined each pendulum, to tell what was edited
+  map<PendulumId, uint64_t> blockHashes;
+  vector<Diagnostic> diagnostics;
+  ostringstream log;
+
+ private:
+  bool Open();
+  void Close();
+  bool ParseSceneFile(PendulumSink& sink);
+  //counts the lines up to offset, which can't be before the last one counted
+  void CountLines(size_t offset);
+
+  MappedFile file_;
+  //the file's, or the buffer's
+  StringSlice text_{nullptr, 0};
+  //Release() has given back the file up to here
+  size_t released_ = 0;
+  //the lines before countedTo_, counted before they are given back, so that
+  //a diagnostic never needs the whole file's line starts
+  size_t countedTo_ = 0;
+  size_t lineCount_ = 0;
+  size_t lineStart_ = 0;
+  Lexer lexer_;
+  string fileName_;
+  double timeDelta_;
+  FileId fileId_ = kNoFile;
+  bool inMemory_ = false;
+  bool failed_ = false;
+};
+
+//what a FileParser leaves behind
+struct ParsedFile {
+  bool opened;
+  Scene scene;
+  map<PendulumId, Range> locationMap;
+  map<PendulumId, uint64_t> blockHashes;
+  vector<Diagnostic> diagnostics;
+  string log;
+};
+
+//reads a single file, can be called from any thread
+ParsedFile ParseFile(const string& fileName, double timeDelta);
+//the same, for text that is already in memory
+ParsedFile ParseBuffer(const string& name, const StringSlice& text,
+    double timeDelta);
+
+//a file's worth of text that never was a file
+struct NamedBuffer {
+  string name;
+  string text;
+};
+
+/*
+ * Reads a list of files into one Scene, a FileParser per file, on a
+ * ThreadPool.  The files are merged in the order they are listed, so the
+ * Scene, locationMap and what is printed are the same as if they had been
+ * read one by one.  The diagnostics are printed as they are merged, and kept
+ * in diagnostics, for all of the files.  The buffer sizes are worked out for
+ * timeDelta, which is PendulumBase::timeDelta as it was when the parser was
+ * made, and is never read by the pool.
+ *
+ * example:
+ * HarmonogramParser parser; //one thread per core
+ * Scene scene;
+ * parser.Parse({"examples/input", "examples/input2"}, scene);
+ *
+ * //or, with nothing on disk
+ * vector<NamedBuffer> generated;
+ * generated.push_back(NamedBuffer{"generated/1", GenerateScene(1)});
+ * parser.Parse(generated, scene);
+ */
+class HarmonogramParser {
+ public:
+  //0 threads means one per core
+  explicit HarmonogramParser(size_t threadCount = 0);
+
+  //clears the scene, then fills and links it
+  void Parse(const list<string>& fileNameList, Scene& scene);
+  //the buffers' names stand for file names
+  void Parse(const vector<NamedBuffer>& buffers, Scene& scene);
 
-  string lastRead;
   map<PendulumId, Range> locationMap;
+  map<PendulumId, uint64_t> blockHashes;
+  //the i-th file's pendulums are Handles()[fileStarts[i] .. fileStarts[i + 1])
+  vector<size_t> fileStarts;
+  vector<Diagnostic> diagnostics;
+  //the files that couldn't be opened, which add nothing to the scene
+  list<string> unopened;
+  double timeDelta;
 
  private:
-  istream* input_;
-  Trie trie_;
-  Location location_;
+  void Merge(vector<future<ParsedFile>>& parsed,
+      const list<string>& fileNameList, Scene& scene);
 
-  void AdvanceCursor();
+  ThreadPool pool_;
 };
 
 }; //namespace pendulumNames
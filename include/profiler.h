@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace profilerNames {
+using std::string;
+using std::vector;
+
+/*
+ * The FrameProfiler records how long each part of a frame takes.  All of the
+ * frame slots are allocated once at construction, and when they are used up
+ * the oldest ones are overwritten, so recording never allocates.  Times are
+ * taken from the monotonic (steady) clock and stored in milliseconds.
+ *
+ * A "frame" is everything that happens between two calls to EndFrame(), which
+ * the Harmonogram calls at the end of on_draw().  Sections which are entered
+ * several times in one frame (e.g. the style paths, once per pendulum) are
+ * summed.
+ *
+ * example:
+ * FrameProfiler profiler(512);
+ * {
+ *   ProfileScope scope(profiler, FrameProfiler::kUpdate);
+ *   UpdateAll();
+ * } // kUpdate += elapsed
+ * profiler.MarkQueueDraw(); // on_draw() will record the latency
+ * ...
+ * profiler.EndFrame();
+ * profiler.Percentile(FrameProfiler::kFrame, .99);
+ */
+class FrameProfiler {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using TimePoint = Clock::time_point;
+
+  enum Section {
+    kFrame,      //time between the ends of two frames
+    kUpdate,     //UpdateAll()
+    kQueueDraw,  //queue_draw() until on_draw() starts
+    kDraw,       //all of on_draw()
+    kPlainDraw,
+    kFadeDraw,
+    kRainbowDraw,
+    kCenterDraw,
+    kSectionCount
+  };
+
+  struct Frame {
+    double ms[kSectionCount];
+  };
+
+  FrameProfiler(size_t frameCount = 1024);
+
+  static TimePoint Now() { return Clock::now(); }
+  static double Milliseconds(TimePoint begin, TimePoint end) {
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+  }
+  static const char* SectionName(Section section);
+
+  void Add(Section section, double ms) { frames_[current_].ms[section] += ms; }
+  void Add(Section section, TimePoint begin) {
+    Add(section, Milliseconds(begin, Now()));
+  }
+  void EndFrame();
+  void MarkQueueDraw();
+  void MarkDrawStart();
+
+  //number of completed frames that are still stored
+  size_t FrameCount() const;
+  //i == 0 is the oldest stored frame
+  const Frame& GetFrame(size_t i) const;
+
+  //into histogram.size() bins, the last one taking everything past maxMs
+  void Histogram(Section section, double maxMs, vector<size_t>& histogram)
+      const;
+  double Percentile(Section section, double fraction) const;
+
+  bool DumpCsv(const string& fileName) const;
+  bool DumpJson(const string& fileName) const;
+
+  bool showOverlay;
+
+ private:
+  vector<Frame> frames_;
+  size_t current_;
+  size_t completed_;
+  TimePoint lastFrameEnd_;
+  TimePoint queueDrawTime_;
+  bool drawQueued_;
+  //used by Percentile, sized once so that the overlay doesn't allocate
+  mutable vector<double> scratch_;
+};
+
+/*
+ * Adds the time from construction to destruction to a section.
+ */
+class ProfileScope {
+ public:
+  ProfileScope(FrameProfiler& profiler, FrameProfiler::Section section) :
+    profiler_(profiler), section_(section), begin_(FrameProfiler::Now()) {}
+  ~ProfileScope() { profiler_.Add(section_, begin_); }
+
+ private:
+  FrameProfiler& profiler_;
+  FrameProfiler::Section section_;
+  FrameProfiler::TimePoint begin_;
+};
+
+}; //namespace profilerNames
@@ -0,0 +1,59 @@
+//range_index.h
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "location.h"
+
+namespace pendulumNames {
+using std::unordered_map;
+using std::vector;
+
+/*
+ * The source ranges of the pendulums, for finding the one the editor's cursor
+ * is in without looking at all of them.  The ranges are identified by small
+ * integers (e.g. a DrawerHandle).  Insert() them all, then Build() before
+ * asking.
+ *
+ * Each file's ranges are kept sorted by where they begin (the outer one
+ * first, when two begin together), each with the innermost range it is
+ * inside of.  Innermost() binary searches for the last range that begins at
+ * or before the location, then goes out through the ranges around that one
+ * until one also ends after it: O(log n), plus the depth of the nesting,
+ * which is 1 for a compound made of pendulums.  The parser's ranges are
+ * either nested or apart; ranges that overlap otherwise are still found, but
+ * not always the innermost of them.
+ *
+ * example:
+ * RangeIndex index;
+ * index.Insert(0, parser.locationMap["4to3"]);   //the whole file
+ * index.Insert(1, parser.locationMap["4to3p1"]); //lines 10 to 19
+ * index.Build();
+ * index.Innermost(Location{file, 150}); // 1, it's on line 14
+ */
+class RangeIndex {
+ public:
+  static const size_t kNone = (size_t)-1;
+
+  void Clear();
+  //ranges that aren't Valid() are left out
+  void Insert(size_t id, const Range& range);
+  void Build();
+  //the id of the innermost range with where in it (ends included), or kNone
+  size_t Innermost(const Location& where) const;
+
+ private:
+  struct Entry {
+    size_t begin;
+    size_t end;
+    size_t id;
+    //the index of the entry it is inside of, or kNone
+    size_t parent;
+  };
+
+  unordered_map<FileId, vector<Entry>> files_;
+};
+
+}; //namespace pendulumNames
@@ -1,103 +1,222 @@
-//ringbuffer.h
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <vector>
 
+#include "bufferpool.h"
+
 /*
- * The Ringbuffer holds a vector, and allows range-based for loops to go from
- * the "front_index", to the end, then start from the beginning and continuing
- * iterating to the "front_index".  It offeres limited functionality as a
- * general container, but is useful for the pendulums.
+ * The Ringbuffer holds the last "size()" values that were pushed into it.
+ * The storage is a power of two, so wrapping around is a mask instead of a
+ * modulo, and the contents can be read as (at most) two contiguous Spans,
+ * oldest first.  Range-based for loops go from the oldest value to the
+ * newest.  It offeres limited functionality as a general container, but is
+ * useful for the pendulums.
  *
  * example:
  * RingBuffer<int> rbi; // only default construction
- * rbi.Fill(3,0); // resizes the buffer to "3", fills all positions with 0
+ * rbi.Fill(3,0); // holds 3 values (capacity 4), all of them 0
  * for (int i = 0; i < 5; ++i) rbi.Push(i);
- *          // Push(val) puts "val" into the position after "front_index", and
- *          // wraps around to the beginning once the end is reached, rbi.buffer
- *          // now holds {3,4,5}
- * for (auto& i : rbi) rbi *= 2; //rbi.buffer == {6,8,10}
+ *          // Push(val) overwrites the oldest value, rbi now holds {2,3,4}
+ * for (int i : rbi) cout << i; // 234
  *
- * rbi.Translate(2); 
- *          // Translate() uses += to add a value to every item. rbi.buffer ==
- *          // {8, 10, 12}
+ * rbi.Translate(2);
+ *          // Translate() adds a value to every item. rbi holds {4,5,6}
  *
+ * for (const auto& span : rbi.Spans())
+ *   for (int* i = span.begin(); i != span.end(); ++i) ...
+ *          // the same as the range-based for, but with raw pointers
  *
+ * Translate() is lazy: it only adds to Offset(), and the values are stored
+ * relative to it (Push(val) stores val - Offset()).  Reading with [],
+ * front(), back() or the iterators adds the offset back, while Spans() and
+ * Stored() see the values as they are stored, so a bulk consumer adds
+ * Offset() itself (e.g. once, with cairo's translate).  Fold() adds the
+ * offset into the storage when the plain values are needed.
  */
 
 using std::vector;
 
+template<typename T>
+struct Span {
+  T* data;
+  size_t size;
+
+  T* begin() const { return data; }
+  T* end() const { return data + size; }
+  bool empty() const { return size == 0; }
+};
+
+inline size_t NextPowerOfTwo(size_t n) {
+  size_t power = 1;
+  while (power < n) power <<= 1;
+  return power;
+}
+
+/*
+ * Iterates by counting from the oldest value, so begin() and end() are never
+ * ambiguous (even when the buffer is full).  Dereferencing gives the value
+ * with the offset applied, by value.
+ */
 template<typename T>
 class RingBufferIterator {
  public:
-  size_t pos;
-  vector<T>* ptr;
-  size_t& operator++() {
-    ++pos %= ptr->size();
-    return pos;
-  }
-  size_t& operator--() {
-    (pos == 0) ? pos = ptr->size() - 1 : --pos;
-    return pos;
-  }
-  T* get() { return &(*ptr)[pos]; }
-  T& operator*() { return (*ptr)[pos]; }
-  T* operator->() { return get(); }
-  const T& operator*() const { return (*ptr)[pos]; }
-  const T& operator->() const { return (*ptr)[pos]; }
-  bool operator==(const RingBufferIterator& l) const { return pos == l.pos; }
+  const T* data;
+  size_t mask;
+  size_t start;
+  size_t count;
+  T offset;
+
+  RingBufferIterator& operator++() { ++count; return *this; }
+  RingBufferIterator& operator--() { --count; return *this; }
+  T operator*() const { return data[(start + count) & mask] + offset; }
+  bool operator==(const RingBufferIterator& l) const { return count == l.count; }
   bool operator!=(const RingBufferIterator& l) const { return !(*this == l); }
 };
 
 /*
  * The type used for the ringbuffer must be support default construction, copy
- * construction, and (if Translate is to be used) +=,
+ * construction, + and -.  T{} is taken as the zero offset.
+ *
+ * The storage is either the RingBuffer's own, or borrowed from a BufferPool
+ * (which then has to outlive it).  A RingBuffer can be moved but not copied.
  */
 template<typename T>
 class RingBuffer {
  public:
   using Iterator = RingBufferIterator<T>;
 
-  RingBuffer() : 
-    front_index(0), buffer() {}
+  RingBuffer() :
+    head_(0), size_(0), mask_(0), offset_(), data_(nullptr), owned_() {}
+
+  RingBuffer(RingBuffer&&) = default;
+  RingBuffer& operator=(RingBuffer&&) = default;
+  RingBuffer(const RingBuffer&) = delete;
+  RingBuffer& operator=(const RingBuffer&) = delete;
+
+  Iterator begin() const { return {data_, mask_, Start(), 0, offset_}; }
+  Iterator end() const { return {data_, mask_, Start(), size_, offset_}; }
 
-  Iterator begin() {
-    if (front_index == buffer.size() - 1) return Iterator{0, &buffer};
-    else return {front_index + 1, &buffer};
+  //oldest value
+  T front() const { return (*this)[0]; }
+  //newest value
+  T back() const { return (*this)[size_ - 1]; }
+
+  const T& Offset() const { return offset_; }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return data_ ? mask_ + 1 : 0; }
+  bool empty() const { return size_ == 0; }
+
+  /*
+   * The stored contents, oldest first.  The second Span is empty unless the
+   * values wrap around the end of the storage.
+   */
+  std::array<Span<T>, 2> Spans() {
+    size_t start = Start();
+    size_t first = std::min(size_, capacity() - start);
+    return {{ {data_ + start, first}, {data_, size_ - first} }};
   }
 
-  Iterator end() {
-    return {front_index, &buffer};
+  std::array<Span<const T>, 2> Spans() const {
+    size_t start = Start();
+    size_t first = std::min(size_, capacity() - start);
+    return {{ {data_ + start, first}, {data_, size_ - first} }};
   }
 
-  T& front() {
-    return *begin();
+  void Push(const T& position) {
+    if (size_ == 0) Fill(1, position);
+    data_[head_] = position - offset_;
+    head_ = (head_ + 1) & mask_;
   }
 
-  void Push(const T& position) { 
-    if (buffer.size() == 0) {
-      buffer.push_back(position);
+  /*
+   * Holds "size" copies of pos afterwards.  The storage is reused if it is
+   * big enough, otherwise it comes from the pool (when there is room) or is
+   * allocated.
+   */
+  void Fill(size_t size, const T& pos, BufferPool<T>* pool = nullptr) {
+    size_t capacity = NextPowerOfTwo(size);
+    if (capacity > this->capacity() || pool) SetStorage(capacity, pool);
+    std::fill(data_, data_ + capacity, pos);
+    size_ = size;
+    head_ = size & mask_;
+    offset_ = T();
+  }
+
+  /*
+   * Keeps the newest min(size, size()) values, growing pads the older end with
+   * the oldest value.  With a pool, the values always move to storage from the
+   * pool, otherwise the storage only changes when it is too small.
+   */
+  void Resize(size_t size, BufferPool<T>* pool = nullptr) {
+    if (size_ == 0) return Fill(size, T(), pool);
+    size_t keep = std::min(size, size_);
+    const T oldest = Stored(size_ - keep);
+    size_t capacity = NextPowerOfTwo(size);
+    if (capacity > this->capacity() || pool) {
+      //copy the newest values to the front of the new storage
+      vector<T> owned;
+      T* data = pool ? pool->Allocate(capacity) : nullptr;
+      if (!data) {
+        owned.resize(capacity);
+        data = owned.data();
+      }
+      std::fill(data, data + size - keep, oldest);
+      for (size_t i = 0; i < keep; ++i) {
+        data[size - keep + i] = Stored(size_ - keep + i);
+      }
+      owned_.swap(owned);
+      data_ = data;
+      mask_ = capacity - 1;
+      head_ = size & mask_;
     } else {
-      ++front_index %= buffer.size();
-      buffer[front_index] = position; 
+      //the slots just before the oldest value become the new oldest ones
+      for (size_t i = size_; i < size; ++i) {
+        data_[(head_ - i - 1) & mask_] = oldest;
+      }
     }
+    size_ = size;
   }
 
-  void Fill(size_t size, const T& pos) {
-    buffer.clear();
-    buffer.reserve(size);
-    for(size_t i = 0; i < size; ++i) buffer.push_back(pos);
-  }
+  //O(1), see Fold()
+  void Translate(const T& p) { offset_ = offset_ + p; }
 
-  void Translate(const T& p) {
-    for (auto& pos : buffer) { pos += p; }
+  //applies the offset to every stored value
+  void Fold() {
+    for (const auto& span : Spans()) {
+      T* data = span.data;
+      for (size_t i = 0; i < span.size; ++i) data[i] = data[i] + offset_;
+    }
+    offset_ = T();
   }
 
-  T& operator[](size_t i) { return buffer[i]; }
-  const T& operator[](size_t i) const { return buffer[i]; }
+  //i == 0 is the oldest value, i == size() - 1 the newest
+  T operator[](size_t i) const { return Stored(i) + offset_; }
+  const T& Stored(size_t i) const { return data_[(Start() + i) & mask_]; }
 
-  //TODO make these private, possibly needing a friend class...
-  size_t front_index;
-  vector<T> buffer;
-};
+ private:
+  size_t Start() const { return (head_ - size_) & mask_; }
+
+  //doesn't keep the contents, that's up to the caller
+  void SetStorage(size_t capacity, BufferPool<T>* pool) {
+    T* data = pool ? pool->Allocate(capacity) : nullptr;
+    if (data) {
+      owned_ = vector<T>();
+    } else {
+      owned_.resize(capacity);
+      data = owned_.data();
+    }
+    data_ = data;
+    mask_ = capacity - 1;
+  }
 
+  //where the next value is written
+  size_t head_;
+  size_t size_;
+  size_t mask_;
+  T offset_;
+  T* data_;
+  vector<T> owned_;
+};
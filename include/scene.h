@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pendulum.h"
+
+namespace pendulumNames {
+using std::pair;
+using std::string;
+using std::vector;
+
+/*
+ * Identifies a pendulum in a Scene by its kind and its index in that kind's
+ * array.  Unlike a pointer, it stays valid while the Scene grows.
+ */
+struct PendulumHandle {
+  enum Kind : uint32_t {kSimple, kCompound, kNone};
+
+  Kind kind;
+  uint32_t index;
+
+  bool Valid() const { return kind != kNone; }
+  bool operator==(const PendulumHandle& rhs) const {
+    return kind == rhs.kind && index == rhs.index;
+  }
+  bool operator!=(const PendulumHandle& rhs) const { return !(*this == rhs); }
+};
+
+const PendulumHandle kNoPendulum{PendulumHandle::kNone, 0};
+
+/*
+ * Holds all of the pendulums, by value, in one contiguous array per kind.
+ * Clear() only resets the arrays (they keep their capacity), so reloading a
+ * scene of the same size doesn't allocate for the pendulums at all.
+ *
+ * A CompoundPendulum's children are recorded as handles with AddChild(), and
+ * turned into pointers by Link() once the arrays are done growing.  Adding
+ * pendulums after Link() invalidates those pointers, so Link() again.
+ *
+ * The children of a compound may be compounds themselves, and a child may be
+ * shared by any number of compounds.  Link() sorts the compounds so that each
+ * one comes after all of its children, and UpdatePositions() goes through
+ * them in that order: every pendulum's position is computed exactly once per
+ * tick, and the compounds only read their children's (already computed)
+ * positions.  A compound that is part of a cycle can't be ordered, so Link()
+ * lists it in Cyclic(), for the caller to report, and leaves it (and
+ * everything made of it) standing still at its center, with a trail as long
+ * as its longest child's.
+ *
+ * example:
+ * Scene scene;
+ * PendulumHandle a = scene.Add(simple1);
+ * PendulumHandle b = scene.Add(simple2);
+ * PendulumHandle c = scene.Add(compound);
+ * scene.AddChild(c, a);
+ * scene.AddChild(c, b);
+ * scene.Link();
+ * scene.UpdatePositions(); //a and b, then c
+ * for (PendulumHandle h : scene.Handles()) cout << scene[h].ToString();
+ */
+class Scene {
+ public:
+  PendulumHandle Add(SimplePendulum pendulum);
+  PendulumHandle Add(CompoundPendulum compound);
+  void AddChild(PendulumHandle compound, PendulumHandle child);
+  //moves other's pendulums to the end of this one, Link() afterwards
+  void Append(Scene&& other);
+  /*
+   * copies other's pendulums Handles()[begin .. end) to the end of this one,
+   * with the children among them, Link() afterwards
+   */
+  void AppendCopy(const Scene& other, size_t begin, size_t end);
+  //overwrites a pendulum with a copy of other's (of the same kind)
+  void Replace(PendulumHandle handle, const Scene& other, PendulumHandle from);
+  void Clear();
+  //room for this many more pendulums of each kind
+  void Reserve(size_t simples, size_t compounds);
+  PendulumHandle Find(const string& name) const;
+  //false when some compounds form a cycle
+  bool Link();
+  //the compounds the last Link() couldn't order
+  const vector<PendulumHandle>& Cyclic() const { return cyclic_; }
+  //pointers to the pendulums stay valid, they just change scenes
+  void swap(Scene& other);
+  void UpdatePositions();
+
+  //in the order they were added
+  const vector<PendulumHandle>& Handles() const { return order_; }
+  //(compound, child), in the order they were added
+  const vector<pair<PendulumHandle, PendulumHandle>>& Children() const {
+    return children_;
+  }
+  size_t size() const { return order_.size(); }
+  bool empty() const { return order_.empty(); }
+
+  PendulumBase& operator[](PendulumHandle handle);
+  const PendulumBase& operator[](PendulumHandle handle) const;
+
+ private:
+  void SortCompounds();
+
+  vector<SimplePendulum> simples_;
+  vector<CompoundPendulum> compounds_;
+  vector<PendulumHandle> order_;
+  //(compound, child)
+  vector<pair<PendulumHandle, PendulumHandle>> children_;
+  //indices into compounds_, children first
+  vector<uint32_t> compoundOrder_;
+  vector<PendulumHandle> cyclic_;
+};
+
+}; //namespace pendulumNames
@@ -0,0 +1,86 @@
+//scene_file.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "location.h"
+#include "scene.h"
+
+namespace pendulumNames {
+using std::map;
+using std::string;
+
+/*
+ * A compiled scene: what the parser would make of some .harm files, written
+ * out as fixed layout records so that it can be loaded by mapping the file
+ * and copying the records into a Scene, with nothing to tokenize or convert.
+ * harmc writes them, and the FileParser loads one in place of a .harm file
+ * when it starts with kSceneMagic, so they can be given to harmonogram like
+ * any other input.
+ *
+ * The layout is that of the machine that wrote it (the header records the
+ * byte order and version, and a mismatch is rejected rather than converted):
+ *
+ *   SceneFileHeader
+ *   strings    the names and file names, one after the other, unterminated
+ *   simples    SimpleRecord[simpleCount]
+ *   compounds  CompoundRecord[compoundCount]
+ *   order      uint8_t[orderCount], the kinds of the scene's Handles(), each
+ *              kind's records are taken in turn
+ *   children   PendulumHandle[2*childCount], (compound, child) pairs
+ *   hashes     HashRecord[hashCount], the block hashes, sorted by name
+ *   sources    SourceRecord[sourceCount], the files the locations are in
+ *   lines      the sources' line lengths, as varints, linesSize bytes
+ *   locations  LocationRecord[locationCount], sorted by name
+ *
+ * The last three are optional, they are for the vim server.  The sources'
+ * lines are those they had when they were compiled, so that the locations
+ * still make sense after a source has been edited, or if it is gone.
+ *
+ * Every section starts on an 8 byte boundary.  The point is loading fast, not
+ * small files, but nothing is wider than it has to be: with the locations, a
+ * big scene's file is a little smaller than the text it was compiled from.
+ * The buffer sizes depend on timeDelta, so they are worked out again when the
+ * file is loaded, for the one it is given.
+ *
+ * example:
+ * HarmonogramParser parser;
+ * Scene scene;
+ * parser.Parse({"examples/input"}, scene);
+ * WriteSceneFile("input.harmc", scene, parser.blockHashes, &parser.locationMap);
+ *
+ * MappedFile file("input.harmc");
+ * Scene loaded;
+ * map<string, uint64_t> hashes;
+ * map<string, Range> locations;
+ * if (!ReadSceneFile(file.begin(), file.end(), loaded, PendulumBase::timeDelta,
+ *       hashes, &locations)) {
+ *   cout << "not a scene file" << endl;
+ * }
+ */
+const char kSceneMagic[8] = {'H', 'A', 'R', 'M', 'S', 'C', 'N', '\0'};
+const uint32_t kSceneVersion = 3;
+
+//true if the buffer looks like a scene file (it may still be a bad one)
+bool IsSceneFile(const char* begin, const char* end);
+
+/*
+ * Adds a scene file's pendulums to the end of scene (without linking it),
+ * along with their block hashes and, if the file has them and locationMap
+ * isn't null, their source ranges.  False, having added nothing, if it is
+ * truncated, from another version or machine, refers to anything that isn't
+ * there, or has compounds made of themselves (through any number of others).
+ */
+bool ReadSceneFile(const char* begin, const char* end, Scene& scene,
+    double timeDelta, map<string, uint64_t>& blockHashes,
+    map<string, Range>* locationMap);
+
+//leaves out the locations if locationMap is null, false if it can't write
+bool WriteSceneFile(const string& fileName, const Scene& scene,
+    const map<string, uint64_t>& blockHashes,
+    const map<string, Range>* locationMap);
+
+}; //namespace pendulumNames
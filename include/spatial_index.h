@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "pendulum.h"
+
+namespace pendulumNames {
+using std::unordered_map;
+using std::vector;
+
+/*
+ * A uniform grid over points (the pendulums' centers), for finding the one
+ * nearest to the mouse without looking at all of them.  The points are
+ * identified by small integers (e.g. a DrawerHandle), and Move() only touches
+ * the two cells involved, so it can be called on every drag event.
+ *
+ * A query looks at the 3x3 cells around the point, so it finds everything
+ * within cellSize.
+ *
+ * example:
+ * PointGrid grid(15);
+ * grid.Insert(0, {100, 100});
+ * grid.Insert(1, {110, 100});
+ * grid.Nearest({108, 101}, 15); // 1
+ * grid.Move(1, {300, 300});
+ * grid.Nearest({108, 101}, 15); // 0
+ */
+class PointGrid {
+ public:
+  static const size_t kNone = (size_t)-1;
+
+  explicit PointGrid(double cellSize);
+
+  void Clear();
+  void Insert(size_t id, const Position& position);
+  void Move(size_t id, const Position& position);
+  //the closest point within tolerance (<= cellSize) of position, or kNone
+  size_t Nearest(const Position& position, double tolerance) const;
+
+ private:
+  uint64_t Key(const Position& position) const;
+  uint64_t Key(int64_t cx, int64_t cy) const;
+  int64_t Cell(double coordinate) const;
+
+  double cellSize_;
+  unordered_map<uint64_t, vector<size_t>> cells_;
+  vector<Position> positions_;
+};
+
+/*
+ * A uniform grid over line segments (the pendulums' trails), for finding the
+ * trail under the mouse.  Every segment is listed in each cell its bounding
+ * box touches, along with its end points, so a query only needs the cells
+ * around the point.
+ *
+ * A segment is identified by its owner (e.g. a DrawerHandle) and a sequence
+ * number which is unique for that owner, so that a trail can add its newest
+ * segment and remove its oldest one on every step.  Remove() has to be given
+ * the same end points as Insert(), to find the same cells.
+ *
+ * example:
+ * SegmentGrid grid(16);
+ * grid.Insert(0, 1, {0, 0}, {100, 0});
+ * grid.Insert(1, 1, {0, 10}, {100, 10});
+ * grid.Nearest({50, 8}, 5); // 1
+ * grid.Remove(1, 1, {0, 10}, {100, 10});
+ * grid.Nearest({50, 8}, 5); // kNone, 0 is 8 away
+ */
+class SegmentGrid {
+ public:
+  static const size_t kNone = (size_t)-1;
+
+  explicit SegmentGrid(double cellSize);
+
+  void Clear();
+  void Insert(size_t owner, uint32_t seq, const Position& a, const Position& b);
+  void Remove(size_t owner, uint32_t seq, const Position& a, const Position& b);
+  //the owner of the closest segment within tolerance of position, or kNone
+  size_t Nearest(const Position& position, double tolerance) const;
+
+ private:
+  struct Segment {
+    uint32_t owner;
+    uint32_t seq;
+    //floats are plenty for picking, and keep the cells small
+    float ax, ay, bx, by;
+  };
+
+  template<typename F>
+  void ForEachCell(const Position& a, const Position& b, F f);
+  int64_t Cell(double coordinate) const;
+
+  double cellSize_;
+  unordered_map<uint64_t, vector<Segment>> cells_;
+};
+
+}; //namespace pendulumNames
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "ringbuffer.h"
+
+/*
+ * The concurrent sibling of the RingBuffer: one producer thread Push()es, one
+ * consumer thread reads, and neither ever waits for the other.  Like the
+ * RingBuffer it keeps only the newest capacity() values, the producer simply
+ * overwrites the oldest ones, so a slow consumer loses samples rather than
+ * blocking the simulation.
+ *
+ * head_ counts every value ever pushed, and value i goes in slot (i & mask_).
+ * Each slot is a seqlock: its sequence is 2*i + 1 while value i is being
+ * written and 2*i + 2 once it is there.  The producer marks the slot odd,
+ * fences (release), writes the value, then stores the even sequence and
+ * head_ + 1 with release.  The consumer reads the sequence with acquire,
+ * copies the value, fences (acquire) and reads the sequence again: unless
+ * both are 2*i + 2, value i was overwritten (or is being), and the copy is
+ * thrown away.  The value is copied in and out as relaxed atomic words, so a
+ * copy that races with a write is merely torn, never undefined, which is also
+ * why T has to be trivially copyable.
+ *
+ * head_ and the consumer's cursor live on their own cache lines, so the two
+ * threads don't bounce a line between them on every push.
+ *
+ * example:
+ * SpscRingBuffer<Position> samples(1024);
+ * //producer thread
+ * samples.Push(pendulum.position);
+ * //consumer thread, only the new samples are copied
+ * samples.Drain([&](const Position& p) { trail.Push(p); });
+ * //or the newest 100, oldest first
+ * Position latest[100];
+ * size_t n = samples.CopyLatest(latest, 100);
+ */
+template<typename T>
+class SpscRingBuffer {
+  static_assert(std::is_trivially_copyable<T>::value,
+      "SpscRingBuffer values are copied while they may be overwritten");
+
+ public:
+  static const size_t kCacheLine = 64;
+
+  explicit SpscRingBuffer(size_t capacity) :
+    slots_(NextPowerOfTwo(std::max<size_t>(capacity, 2))),
+    mask_(slots_.size() - 1), head_(0), readCursor_(0), dropped_(0) {}
+
+  SpscRingBuffer(const SpscRingBuffer&) = delete;
+  SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+  size_t capacity() const { return slots_.size(); }
+
+  //producer only
+  void Push(const T& value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[head & mask_];
+    slot.sequence.store(2*head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    uint64_t words[kWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+    for (size_t w = 0; w < kWords; ++w) {
+      slot.words[w].store(words[w], std::memory_order_relaxed);
+    }
+    slot.sequence.store(2*head + 2, std::memory_order_release);
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  //number of values pushed so far, from either thread
+  size_t Pushed() const { return head_.load(std::memory_order_acquire); }
+
+  /*
+   * Consumer only.  Copies the newest (at most n) values into out, oldest
+   * first, and returns how many were copied.  Fewer than n are returned if
+   * fewer were pushed, or if the producer overwrote the oldest ones during the
+   * copy.
+   */
+  size_t CopyLatest(T* out, size_t n) const {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t count = std::min(std::min(n, capacity()), head);
+    //newest first, the oldest are the first to be overwritten
+    size_t copied = 0;
+    while (copied < count && Read(head - 1 - copied, out[count - 1 - copied])) {
+      ++copied;
+    }
+    std::memmove(out, out + (count - copied), copied*sizeof(T));
+    return copied;
+  }
+
+  /*
+   * Consumer only.  Calls f(const T&) for every value pushed since the last
+   * Drain(), oldest first, and returns how many there were.  Values the
+   * producer overwrote before they were read are skipped and counted in
+   * Dropped().
+   */
+  template<typename F>
+  size_t Drain(F f) {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t drained = 0;
+    if (head - readCursor_ > capacity()) {
+      dropped_ += head - capacity() - readCursor_;
+      readCursor_ = head - capacity();
+    }
+    while (readCursor_ != head) {
+      T value;
+      if (!Read(readCursor_, value)) {
+        //lapped: the slot holds (or is getting) a newer value, written, and
+        //each value overwrites the one a capacity() before it
+        const Slot& slot = slots_[readCursor_ & mask_];
+        size_t written =
+            (slot.sequence.load(std::memory_order_acquire) - 1)/2;
+        size_t oldest = written - capacity() + 1;
+        dropped_ += oldest - readCursor_;
+        readCursor_ = oldest;
+        head = std::max(head, oldest);
+        continue;
+      }
+      f(value);
+      ++readCursor_;
+      ++drained;
+    }
+    return drained;
+  }
+
+  //consumer only
+  size_t Dropped() const { return dropped_; }
+
+ private:
+  static const size_t kWords = (sizeof(T) + 7)/8;
+
+  //zeroed by the vector, a sequence of 0 is no value at all
+  struct Slot {
+    std::atomic<size_t> sequence;
+    std::atomic<uint64_t> words[kWords];
+  };
+
+  //false if value index isn't in its slot any more (or is being overwritten)
+  bool Read(size_t index, T& value) const {
+    const Slot& slot = slots_[index & mask_];
+    size_t sequence = 2*index + 2;
+    if (slot.sequence.load(std::memory_order_acquire) != sequence) return false;
+    uint64_t words[kWords];
+    for (size_t w = 0; w < kWords; ++w) {
+      words[w] = slot.words[w].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence) return false;
+    std::memcpy(&value, words, sizeof(T));
+    return true;
+  }
+
+  std::vector<Slot> slots_;
+  size_t mask_;
+  //written by the producer
+  alignas(kCacheLine) std::atomic<size_t> head_;
+  //touched only by the consumer
+  alignas(kCacheLine) size_t readCursor_;
+  size_t dropped_;
+};
@@ -0,0 +1,60 @@
+//thread_pool.h
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed number of threads working through a queue of tasks, in the order
+ * they were submitted.  Submit() returns a future for the task's result, so
+ * whoever submitted it can wait for it (and get any exception it threw).  The
+ * destructor finishes the queued tasks, then joins the threads.
+ *
+ * example:
+ * ThreadPool pool; //one thread per core
+ * vector<future<size_t>> sizes;
+ * for (const string& name : names) {
+ *   sizes.push_back(pool.Submit([name]() { return MappedFile(name).size(); }));
+ * }
+ * for (auto& size : sizes) cout << size.get() << endl;
+ */
+class ThreadPool {
+ public:
+  //0 threads means one per core
+  explicit ThreadPool(size_t threadCount = 0);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  template<typename F>
+  std::future<typename std::result_of<F()>::type> Submit(F f) {
+    typedef typename std::result_of<F()>::type Result;
+    //std::function wants something it can copy
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(f));
+    std::future<Result> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push([task]() { (*task)(); });
+    }
+    wake_.notify_one();
+    return result;
+  }
+
+  size_t size() const { return threads_.size(); }
+
+ private:
+  void Work();
+
+  std::vector<std::thread> threads_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stopping_;
+};
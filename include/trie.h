@@ -1,11 +1,51 @@
 //trie.h
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <istream>
 #include <list>
 #include <memory>
 #include <string>
+#include <vector>
+
+/*
+ * A Trie compiled into a flat table: one row of 256 next states per state,
+ * with the case folding and the fallbacks already resolved, so recognizing
+ * the tokens in a text costs one lookup per byte.  A state accepts when the
+ * text read so far ends with a token, Accept() then gives the id it was
+ * inserted with and Length() how many bytes it spans.
+ *
+ * example:
+ * Trie trie;
+ * trie.Insert("name:", kTokName);
+ * TokenDfa dfa = trie.Compile();
+ * TokenDfa::State state = TokenDfa::kStart;
+ * for (char c : string("  NAME: x")) {
+ *   state = dfa.Next(state, c);
+ *   if (dfa.Accept(state) != TokenDfa::kNoToken) break; //kTokName, 5 bytes
+ * }
+ */
+class TokenDfa {
+ public:
+  typedef uint16_t State;
+  static const State kStart = 0;
+  static const int kNoToken = -1;
+
+  State Next(State state, char c) const {
+    return next_[(size_t)state*256 + (unsigned char)c];
+  }
+  int Accept(State state) const { return accept_[state]; }
+  size_t Length(State state) const { return length_[state]; }
+  size_t StateCount() const { return accept_.size(); }
+
+ private:
+  friend class Trie;
+
+  std::vector<State> next_;
+  std::vector<int> accept_;
+  std::vector<size_t> length_;
+};
 
 class TrieNode;
 class Trie {
@@ -13,7 +53,9 @@ class Trie {
   Trie();
 
   void Insert(const std::list<std::string>& tokens);
-  void Insert(const std::string& branch);
+  //tokenId is what a compiled TokenDfa reports for branch
+  void Insert(const std::string& branch, int tokenId = 0);
+  TokenDfa Compile() const;
 
   std::string GetToken();
 
@@ -5,26 +5,43 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <set>
 #include <sstream>
 #include <string>
+#include <utility>
 
+#include "editor_channel.h"
 #include "location.h"
 
 namespace vimserverNames {
 using std::string;
 using std::list;
 using std::map;
+using std::set;
 
 typedef size_t HighlighId;
 
 //chokepoint for system calls
 void MySystemCall(const std::string& command);
 
+/*
+ * Drives a vim (gvim by default) which it starts with the files, through an
+ * EditorChannel: vim is started with $HARMONOGRAM_CHANNEL set to a unix
+ * socket the VimServer listens on, and told to connect to it, after which a
+ * query is a message each way rather than a few processes and a file.  The
+ * editor can be any command that does the same, e.g. elf/mockeditor.
+ *
+ * example:
+ * VimServer server("Harmonogram");
+ * server.SetFileNameList({"examples/input"});
+ * server.Activate();
+ * Location cursor;
+ * if (server.GetCursor(cursor)) cout << cursor.ToString() << endl;
+ */
 class VimServer {
  public:
-  static size_t fileId;
-
-  VimServer(const string& name = "VimServer");
+  //the editor's command is given the files, and has to connect to the channel
+  VimServer(const string& name = "VimServer", const string& editor = "");
 
   bool Activate();
   bool CheckServer(double timeout = .5);
@@ -32,11 +49,16 @@ class VimServer {
   bool GetCursor(Location& location);
   string GetName() { return name_; };
   bool HighlightPattern(const string& pattern);
+  //all of them, with one redraw, in a single round trip
+  bool HighlightPatterns(const list<string>& highlight,
+      const list<string>& unhighlight = {});
   bool HighlightRange(const Range& range);
   bool IsActive() { return active_; }
   bool Redraw();
   bool SetCursor(const Location& location);
   void SetFileNameList(const list<string>&);
+  //just these ranges highlighted: the difference, in a single round trip
+  bool SetHighlightedRanges(const set<Range>& ranges);
   bool SetNormalMode();
   bool UnHighlightPattern(const string& pattern);
   bool UnHighlightRange(const Range& range);
@@ -48,43 +70,37 @@ class VimServer {
   bool setNormal;
  private:
   bool RefreshServer(double timeout = .2);
+  //(key, the expression that adds it), and the keys to delete, in ids
+  template<typename Key>
+  bool ChangeHighlights(map<Key, HighlighId>& ids,
+      const list<std::pair<Key, string>>& add, const list<Key>& remove);
+
+  //the answer to expression, read as a T
+  template<typename T>
+  bool Query(const string& expression, T& out, double timeout = 1) {
+    JsonValue result;
+    if (!channel_.Expr(expression, result, timeout)) return false;
+    std::istringstream(result.text) >> out;
+    return true;
+  }
+
   list<string> fileNameList_;
   map<string, HighlighId> highlightIdMap;
+  map<Range, HighlighId> rangeIdMap_;
   string name_;
+  string editor_;
+  EditorChannel channel_;
   bool active_;
 };
 
-bool GotResponse(const string& fileName, string& response, 
-    char delim, double timeout);
-
-template<typename T>
-bool GetValueFromVimServer(const string& command, T& out,
-    char delim = '>', double timeout = .1) {
-  string response;
-  //pseudo-unique (hidden) file name for the response
-  string responseFileName(".response_" + 
-      std::to_string(++VimServer::fileId));
-
-  //the vim server outputs to stdout, so redirect it to our response file.
-  string myCommand = command + " > " + responseFileName;
-  MySystemCall(myCommand.c_str());
-
-  if (GotResponse(responseFileName, response, delim, timeout)) {
-    //here is the "default" way to convert the string to type T, it could be
-    //paramterized, but this implementation will suffice for my purposes
-    std::cout << response << std::endl;
-    std::istringstream(response) >> out;
-    MySystemCall(string("rm " + responseFileName).c_str());
-    return true;
-  } else {
-    //note, no attempt is made to clean up the file...  maybe implement a
-    //scheduler to deal with this a little better...
-    return false;
-  }
-}
-
+//a string is taken whole, spaces and all
 template<>
-bool GetValueFromVimServer<list<string>>(const string& command, list<string>& out,
-    char delim, double timeout);
+inline bool VimServer::Query<string>(const string& expression, string& out,
+    double timeout) {
+  JsonValue result;
+  if (!channel_.Expr(expression, result, timeout)) return false;
+  out = result.text;
+  return true;
+}
 
 }; //namespace vimserverNames
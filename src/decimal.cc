@@ -0,0 +1,126 @@
+#include "decimal.h"
+
+#include <locale.h>
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace pendulumNames;
+using namespace std;
+
+namespace {
+
+//every power of ten that a double holds exactly
+const double kPowersOfTen[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+const int kMaxExactPower = 22;
+const uint64_t kMaxExactMantissa = (uint64_t)1 << 53;
+//more digits than this don't fit in the uint64_t
+const int kMaxDigits = 19;
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+/*
+ * strtod for the numbers the fast path can't do.  It gets a copy, since it
+ * needs the '\0', and the "C" locale, since the program's locale may well
+ * use ',' as the decimal point.
+ */
+double SlowDecimal(const char* begin, const char* end) {
+  static locale_t cLocale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+  char buffer[128];
+  size_t size = end - begin;
+  if (size < sizeof(buffer)) {
+    memcpy(buffer, begin, size);
+    buffer[size] = '\0';
+    return strtod_l(buffer, nullptr, cLocale);
+  }
+  string copy(begin, end);
+  return strtod_l(copy.c_str(), nullptr, cLocale);
+}
+
+}; //namespace
+
+const char* pendulumNames::DecimalStatusMessage(DecimalStatus status) {
+  switch (status) {
+    case kDecimalOk : return "ok";
+    case kDecimalMissing : return "Expected a number";
+    case kDecimalBadExponent : return "Expected the exponent's digits";
+    case kDecimalBadCharacter : return "Unexpected character in a number";
+    case kDecimalOutOfRange : return "Number out of range";
+  }
+  return "?";
+}
+
+DecimalResult pendulumNames::ParseDecimal(const char* begin, const char* end,
+    double& d) {
+  const char* p = begin;
+  bool negative = false;
+  if (p < end && (*p == '+' || *p == '-')) negative = (*p++ == '-');
+
+  //the significant digits go into mantissa, the rest only move the exponent
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+  bool truncated = false;
+  for (; p < end && IsDigit(*p); ++p) {
+    anyDigits = true;
+    if (digits < kMaxDigits) {
+      mantissa = 10*mantissa + (*p - '0');
+      if (mantissa != 0) ++digits;
+    } else {
+      ++exponent;
+      truncated |= (*p != '0');
+    }
+  }
+  if (p < end && *p == '.') {
+    for (++p; p < end && IsDigit(*p); ++p) {
+      anyDigits = true;
+      if (digits < kMaxDigits) {
+        mantissa = 10*mantissa + (*p - '0');
+        if (mantissa != 0) ++digits;
+        --exponent;
+      } else {
+        truncated |= (*p != '0');
+      }
+    }
+  }
+  if (!anyDigits) return DecimalResult{begin, kDecimalMissing};
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* e = p + 1;
+    bool negativeExponent = false;
+    if (e < end && (*e == '+' || *e == '-')) negativeExponent = (*e++ == '-');
+    if (e == end || !IsDigit(*e)) return DecimalResult{e, kDecimalBadExponent};
+    int written = 0;
+    //anything past this is zero or infinity anyway
+    for (; e < end && IsDigit(*e); ++e) {
+      if (written < 100000) written = 10*written + (*e - '0');
+    }
+    exponent += negativeExponent ? -written : written;
+    p = e;
+  }
+  if (p < end && (isalpha((unsigned char)*p) || *p == '.' || *p == '_')) {
+    return DecimalResult{p, kDecimalBadCharacter};
+  }
+
+  double value;
+  if (mantissa == 0) {
+    value = 0;
+  } else if (!truncated && mantissa <= kMaxExactMantissa &&
+      -kMaxExactPower <= exponent && exponent <= kMaxExactPower) {
+    value = (exponent < 0) ? mantissa/kPowersOfTen[-exponent] :
+                             mantissa*kPowersOfTen[exponent];
+  } else {
+    value = fabs(SlowDecimal(begin, p));
+    if (isinf(value)) return DecimalResult{begin, kDecimalOutOfRange};
+  }
+  d = negative ? -value : value;
+  return DecimalResult{p, kDecimalOk};
+}
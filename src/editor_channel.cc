@@ -0,0 +1,408 @@
+#include "editor_channel.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+namespace vimserverNames {
+
+string JsonQuote(const string& s) {
+  string quoted = "\"";
+  for (char c : s) {
+    switch (c) {
+      case '"' : quoted += "\\\""; break;
+      case '\\' : quoted += "\\\\"; break;
+      case '\n' : quoted += "\\n"; break;
+      case '\t' : quoted += "\\t"; break;
+      default :
+        if ((unsigned char)c < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          quoted += escaped;
+        } else {
+          quoted += c;
+        }
+    }
+  }
+  return quoted + "\"";
+}
+
+string VimString(const string& s) {
+  string quoted = "'";
+  for (char c : s) quoted += (c == '\'') ? "''" : string(1, c);
+  return quoted + "'";
+}
+
+bool IsJsonSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+const char* SkipJsonSpace(const char* c, const char* end) {
+  while (c != end && IsJsonSpace(*c)) ++c;
+  return c;
+}
+
+//just after the '"' that closes the string begin is in, or null
+const char* JsonStringEnd(const char* begin, const char* end) {
+  for (const char* c = begin; c != end; ++c) {
+    if (*c == '\\') {
+      if (++c == end) return nullptr;
+    } else if (*c == '"') {
+      return c + 1;
+    }
+  }
+  return nullptr;
+}
+
+/*
+ * Only the brackets are counted, the value is looked at properly by
+ * ParseJson.  A number (or true...) on its own isn't known to be over until
+ * something comes after it.  A stray ']', '}' or ',' is taken to be a (bad)
+ * value of its own, so that it can be dropped.
+ */
+const char* JsonValueEnd(const char* begin, const char* end) {
+  const char* c = SkipJsonSpace(begin, end);
+  if (c == end) return nullptr;
+  if (*c == '"') return JsonStringEnd(c + 1, end);
+  if (*c == ']' || *c == '}' || *c == ',') return c + 1;
+  if (*c != '[' && *c != '{') {
+    while (c != end && !IsJsonSpace(*c) && *c != ',' && *c != ']' &&
+        *c != '}' && *c != '[' && *c != '{' && *c != '"') ++c;
+    return (c == end) ? nullptr : c;
+  }
+  size_t depth = 0;
+  for (; c != end; ++c) {
+    if (*c == '"') {
+      c = JsonStringEnd(c + 1, end);
+      if (!c) return nullptr;
+      --c;
+    } else if (*c == '[' || *c == '{') {
+      ++depth;
+    } else if ((*c == ']' || *c == '}') && --depth == 0) {
+      return c + 1;
+    }
+  }
+  return nullptr;
+}
+
+void AppendUtf8(string& s, unsigned code) {
+  if (code < 0x80) {
+    s += (char)code;
+  } else if (code < 0x800) {
+    s += (char)(0xc0 | code >> 6);
+    s += (char)(0x80 | (code & 0x3f));
+  } else {
+    s += (char)(0xe0 | code >> 12);
+    s += (char)(0x80 | (code >> 6 & 0x3f));
+    s += (char)(0x80 | (code & 0x3f));
+  }
+}
+
+//reads the value at c, and moves c past it, false if it's malformed
+bool ReadJson(const char*& c, const char* end, JsonValue& value) {
+  c = SkipJsonSpace(c, end);
+  if (c == end) return false;
+  if (*c == '"') {
+    value.kind = JsonValue::kString;
+    for (++c; c != end && *c != '"'; ++c) {
+      if (*c != '\\') {
+        value.text += *c;
+        continue;
+      }
+      if (++c == end) return false;
+      switch (*c) {
+        case 'n' : value.text += '\n'; break;
+        case 't' : value.text += '\t'; break;
+        case 'r' : value.text += '\r'; break;
+        case 'b' : value.text += '\b'; break;
+        case 'f' : value.text += '\f'; break;
+        case 'u' : {
+          if (end - c < 5) return false;
+          char hex[5] = {c[1], c[2], c[3], c[4], '\0'};
+          char* hexEnd;
+          unsigned code = strtoul(hex, &hexEnd, 16);
+          if (hexEnd != hex + 4) return false;
+          AppendUtf8(value.text, code);
+          c += 4;
+          break;
+        }
+        default : value.text += *c;
+      }
+    }
+    if (c == end) return false;
+    ++c;
+    return true;
+  }
+  if (*c == '[') {
+    value.kind = JsonValue::kArray;
+    c = SkipJsonSpace(c + 1, end);
+    if (c != end && *c == ']') {
+      ++c;
+      return true;
+    }
+    while (true) {
+      value.items.emplace_back();
+      if (!ReadJson(c, end, value.items.back())) return false;
+      c = SkipJsonSpace(c, end);
+      if (c == end) return false;
+      if (*(c++) == ']') return true;
+      if (*(c - 1) != ',') return false;
+    }
+  }
+  //where a value should have been
+  if (*c == ']' || *c == '}' || *c == ',') return false;
+  const char* valueEnd = JsonValueEnd(c, end);
+  if (!valueEnd) valueEnd = end;
+  value.text.assign(c, valueEnd);
+  value.kind = (*c == '-' || isdigit((unsigned char)*c)) ?
+      JsonValue::kNumber : JsonValue::kOther;
+  c = valueEnd;
+  return true;
+}
+
+bool ParseJson(const char* begin, const char* end, JsonValue& value) {
+  value = JsonValue();
+  return ReadJson(begin, end, value) && SkipJsonSpace(begin, end) == end;
+}
+
+//From the JsonSocket class
+
+JsonSocket::JsonSocket(JsonSocket&& other)
+  : fd_(other.fd_), buffer_(move(other.buffer_)) {
+  other.fd_ = -1;
+}
+
+JsonSocket& JsonSocket::operator=(JsonSocket&& other) {
+  if (this != &other) {
+    Close();
+    fd_ = other.fd_;
+    buffer_ = move(other.buffer_);
+    other.fd_ = -1;
+  }
+  return *this;
+}
+
+void JsonSocket::Close() {
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  buffer_.clear();
+}
+
+bool JsonSocket::Send(const string& message) {
+  if (fd_ < 0) return false;
+  string line = message + '\n';
+  for (size_t sent = 0; sent < line.size(); ) {
+    //MSG_NOSIGNAL, so that an editor going away isn't a SIGPIPE
+    ssize_t n = send(fd_, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      Close();
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+bool JsonSocket::Receive(JsonValue& message, double timeout) {
+  auto deadline = chrono::steady_clock::now() +
+      chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::duration<double>(timeout));
+  while (fd_ >= 0) {
+    const char* begin = buffer_.data();
+    const char* end = begin + buffer_.size();
+    const char* valueEnd = JsonValueEnd(begin, end);
+    if (valueEnd) {
+      bool parsed = ParseJson(begin, valueEnd, message);
+      //whatever it was, it's gone, so this can't go round forever
+      buffer_.erase(0, max<size_t>(valueEnd - begin, 1));
+      if (parsed) return true;
+      if (chrono::steady_clock::now() >= deadline) return false;
+      continue;
+    }
+    //nothing but space left, or the start of a message
+    if (SkipJsonSpace(begin, end) == end) buffer_.clear();
+
+    auto left = chrono::duration_cast<chrono::milliseconds>(
+        deadline - chrono::steady_clock::now()).count();
+    if (left <= 0) return false;
+    pollfd ready{fd_, POLLIN, 0};
+    int polled = poll(&ready, 1, left);
+    if (polled < 0 && errno == EINTR) continue;
+    if (polled <= 0) return false;
+    char chunk[4096];
+    ssize_t n = recv(fd_, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      Close();
+      return false;
+    }
+    buffer_.append(chunk, n);
+  }
+  return false;
+}
+
+bool UnixAddress(const string& path, sockaddr_un& address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) return false;
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+JsonSocket ConnectChannel(const string& path) {
+  sockaddr_un address;
+  if (!UnixAddress(path, address)) return JsonSocket();
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return JsonSocket();
+  if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+    close(fd);
+    return JsonSocket();
+  }
+  return JsonSocket(fd);
+}
+
+//From the EditorBatch class
+
+size_t EditorBatch::Expr(const string& expression) {
+  items_.push_back(expression);
+  ++expressions_;
+  return items_.size() - 1;
+}
+
+size_t EditorBatch::Ex(const string& command) {
+  items_.push_back("execute(" + VimString(command) + ")");
+  return items_.size() - 1;
+}
+
+void EditorBatch::Clear() {
+  items_.clear();
+  expressions_ = 0;
+  redraw_ = false;
+}
+
+string EditorBatch::Expression() const {
+  string list = "[";
+  for (const string& item : items_) {
+    list += (list.size() > 1 ? ", " : "") + item;
+  }
+  if (redraw_) list += (list.size() > 1 ? ", " : "") + string("execute('redraw')");
+  return list + "]";
+}
+
+//From the EditorChannel class
+
+EditorChannel::~EditorChannel() { Close(); }
+
+bool EditorChannel::Listen(const string& path) {
+  lock_guard<mutex> lock(mutex_);
+  if (listener_ >= 0) close(listener_);
+  sockaddr_un address;
+  if (!UnixAddress(path, address)) return false;
+  listener_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener_ < 0) return false;
+  unlink(path.c_str());
+  if (bind(listener_, (sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(listener_, 1) != 0) {
+    close(listener_);
+    listener_ = -1;
+    return false;
+  }
+  path_ = path;
+  return true;
+}
+
+bool EditorChannel::Accept(double timeout) {
+  lock_guard<mutex> lock(mutex_);
+  if (listener_ < 0) return false;
+  pollfd ready{listener_, POLLIN, 0};
+  if (poll(&ready, 1, (int)(1000*timeout)) <= 0) return false;
+  int fd = accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+  if (fd < 0) return false;
+  socket_ = JsonSocket(fd);
+  return true;
+}
+
+bool EditorChannel::Connected() {
+  lock_guard<mutex> lock(mutex_);
+  return socket_.good();
+}
+
+void EditorChannel::Close() {
+  lock_guard<mutex> lock(mutex_);
+  socket_.Close();
+  if (listener_ >= 0) close(listener_);
+  listener_ = -1;
+  if (!path_.empty()) unlink(path_.c_str());
+  path_.clear();
+}
+
+/*
+ * Whatever comes before the answer is dropped: vim has nothing to say that
+ * harmonogram listens to, and an answer to an earlier Expr() has nobody
+ * waiting for it any more.
+ */
+bool EditorChannel::Expr(const string& expression, JsonValue& result,
+    double timeout) {
+  lock_guard<mutex> lock(mutex_);
+  string id = to_string(-(++nextId_));
+  if (!socket_.Send("[\"expr\"," + JsonQuote(expression) + "," + id + "]")) {
+    return false;
+  }
+  auto deadline = chrono::steady_clock::now() +
+      chrono::duration_cast<chrono::steady_clock::duration>(
+          chrono::duration<double>(timeout));
+  JsonValue message;
+  while (socket_.Receive(message, chrono::duration<double>(
+          deadline - chrono::steady_clock::now()).count())) {
+    if (message.kind != JsonValue::kArray || message.items.size() != 2 ||
+        message.items[0].text != id) continue;
+    result = move(message.items[1]);
+    return !(result.kind == JsonValue::kString && result.text == "ERROR");
+  }
+  return false;
+}
+
+//["expr", expression] without an id is evaluated, but not answered
+bool EditorChannel::Run(const EditorBatch& batch, JsonValue& results,
+    double timeout) {
+  results = JsonValue();
+  if (batch.empty()) return true;
+  if (batch.Silent()) {
+    return Send("[\"expr\"," + JsonQuote(batch.Expression()) + "]");
+  }
+  return Expr(batch.Expression(), results, timeout) &&
+      results.kind == JsonValue::kArray &&
+      results.items.size() == batch.size();
+}
+
+bool EditorChannel::Ex(const string& command) {
+  return Send("[\"ex\"," + JsonQuote(command) + "]");
+}
+
+bool EditorChannel::Normal(const string& keys) {
+  return Send("[\"normal\"," + JsonQuote(keys) + "]");
+}
+
+bool EditorChannel::Redraw() {
+  return Send("[\"redraw\",\"\"]");
+}
+
+bool EditorChannel::Send(const string& message) {
+  lock_guard<mutex> lock(mutex_);
+  return socket_.Send(message);
+}
+
+}; //namespace vimserverNames
@@ -0,0 +1,99 @@
+#include "file_watcher.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+//how long it has to be quiet after a change, in ms
+const int kSettleTime = 50;
+
+}; //namespace
+
+FileWatcher::FileWatcher(const vector<string>& fileNames,
+    function<void(size_t)> changed) : changed_(changed), inotify_(-1),
+    stopPipe_{-1, -1} {
+  inotify_ = inotify_init1(IN_CLOEXEC);
+  if (inotify_ < 0 || pipe(stopPipe_) != 0) {
+    cout << "FileWatcher: couldn't start inotify" << endl;
+    if (inotify_ >= 0) close(inotify_);
+    inotify_ = -1;
+    return;
+  }
+  map<string, int> directories;
+  for (const string& fileName : fileNames) {
+    size_t slash = fileName.find_last_of('/');
+    string directory = (slash == string::npos) ? "." :
+        (slash == 0) ? "/" : fileName.substr(0, slash);
+    if (!directories.count(directory)) {
+      directories[directory] = inotify_add_watch(inotify_, directory.c_str(),
+          IN_CLOSE_WRITE | IN_MOVED_TO);
+      if (directories[directory] < 0) {
+        cout << "FileWatcher: can't watch " << directory << endl;
+      }
+    }
+    files_.push_back(WatchedFile{directories[directory],
+        (slash == string::npos) ? fileName : fileName.substr(slash + 1)});
+  }
+  thread_ = thread(&FileWatcher::Watch, this);
+}
+
+FileWatcher::~FileWatcher() {
+  if (!good()) return;
+  char stop = 0;
+  if (write(stopPipe_[1], &stop, 1) != 1) cout << "FileWatcher: stop" << endl;
+  thread_.join();
+  close(inotify_);
+  close(stopPipe_[0]);
+  close(stopPipe_[1]);
+}
+
+void FileWatcher::Watch() {
+  alignas(inotify_event) char buffer[4096];
+  vector<bool> changed(files_.size(), false);
+  bool pending = false;
+  while (true) {
+    pollfd fds[2] = {{inotify_, POLLIN, 0}, {stopPipe_[0], POLLIN, 0}};
+    //wait for as long as it takes, unless there are changes to report
+    int ready = poll(fds, 2, pending ? kSettleTime : -1);
+    if (ready < 0) continue;
+    if (fds[1].revents) return;
+    if (ready == 0) {
+      //quiet for kSettleTime
+      for (size_t i = 0; i < changed.size(); ++i) {
+        if (changed[i]) changed_(i);
+        changed[i] = false;
+      }
+      pending = false;
+      continue;
+    }
+    ssize_t size = read(inotify_, buffer, sizeof(buffer));
+    if (size <= 0) continue;
+    Collect(buffer, size, changed);
+    for (bool c : changed) pending |= c;
+  }
+}
+
+void FileWatcher::Collect(const char* buffer, size_t size,
+    vector<bool>& changed) {
+  for (size_t at = 0; at < size; ) {
+    const inotify_event* event =
+      reinterpret_cast<const inotify_event*>(buffer + at);
+    at += sizeof(inotify_event) + event->len;
+    if (event->len == 0) continue;
+    for (size_t i = 0; i < files_.size(); ++i) {
+      if (files_[i].directory == event->wd && files_[i].name == event->name) {
+        changed[i] = true;
+      }
+    }
+  }
+}
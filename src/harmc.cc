@@ -0,0 +1,63 @@
+#include <iostream>
+#include <list>
+#include <string>
+
+#include "pendulum.h"
+#include "pendulum_parser.h"
+#include "scene.h"
+#include "scene_file.h"
+
+using namespace pendulumNames;
+using namespace std;
+
+//only used for the buffer sizes, which are worked out again when loading
+double PendulumBase::timeDelta = .01;
+
+/*
+ * Compiles .harm files into a single scene file (see scene_file.h), which
+ * harmonogram loads much faster than it parses the text.  The source ranges
+ * are kept for the vim server unless --strip is given.
+ *
+ * usage: harmc [--strip] output input...
+ *
+ * Nothing is written if an input can't be opened or has any errors.  As with
+ * harmlint, returns 0 if the output was written, 1 if not, and 2 for bad
+ * arguments.
+ *
+ * example:
+ * harmc examples/all.harmc examples/input examples/input2
+ * harmonogram examples/all.harmc
+ */
+int main(int argc, char** argv) {
+  bool strip = false;
+  string output;
+  list<string> fileNameList;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--strip") strip = true;
+    else if (output.empty()) output = arg;
+    else fileNameList.push_back(arg);
+  }
+  if (fileNameList.empty()) {
+    cout << "usage: harmc [--strip] output input..." << endl;
+    return 2;
+  }
+
+  HarmonogramParser parser;
+  Scene scene;
+  parser.Parse(fileNameList, scene);
+  //they have been printed as the files were merged
+  if (!parser.unopened.empty() || !parser.diagnostics.empty()) {
+    cout << "not written: " << output << ", " << parser.unopened.size()
+         << " files couldn't be opened, " << parser.diagnostics.size()
+         << " errors" << endl;
+    return 1;
+  }
+  if (!WriteSceneFile(output, scene, parser.blockHashes,
+        strip ? nullptr : &parser.locationMap)) {
+    cout << "couldn't write: " << output << endl;
+    return 1;
+  }
+  cout << "wrote: " << output << ", " << scene.size() << " pendulums" << endl;
+  return 0;
+}
@@ -0,0 +1,139 @@
+#include <cctype>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pendulum.h"
+#include "pendulum_parser.h"
+#include "thread_pool.h"
+
+using namespace pendulumNames;
+using namespace std;
+
+//only used for the buffer sizes
+double PendulumBase::timeDelta = .01;
+
+class NullBuffer : public streambuf {
+ protected:
+  int overflow(int c) override { return c; }
+};
+
+//the pendulums are only counted, so that a file of any size can be checked
+class CountingSink : public PendulumSink {
+ public:
+  void OnPendulum(SimplePendulum pendulum, const Range& range,
+      uint64_t blockHash) override {
+    ++count;
+  }
+  void OnCompound(CompoundPendulum compound, size_t children,
+      const Range& range, uint64_t blockHash) override {
+    ++count;
+  }
+
+  size_t count = 0;
+};
+
+//what is kept of a file once it's checked
+struct LintResult {
+  bool opened;
+  size_t pendulums;
+  vector<Diagnostic> diagnostics;
+};
+
+/*
+ * Checks any number of .harm files (or scene files) in one process, a
+ * FileParser per file on a ThreadPool, printing every diagnostic (in the
+ * order the files were given) and then a summary.  The file names can also
+ * come one per line from stdin, with "-".
+ *
+ * usage: harmlint [--threads=N] [--quiet] file... | -
+ *
+ * Returns 0 if every file was read without an error, 1 if not, and 2 for bad
+ * arguments (N is 0, for one thread per core, up to kMaxThreads).
+ *
+ * example:
+ * find scenes -name '*.harm' | harmlint --quiet -
+ */
+//more than that is a typo, and more than the system will start
+const size_t kMaxThreads = 1024;
+
+int main(int argc, char** argv) {
+  const string usage = "usage: harmlint [--threads=N] [--quiet] file... | -";
+  const string threadsFlag = "--threads=";
+  size_t threadCount = 0;
+  bool quiet = false;
+  vector<string> fileNames;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg.compare(0, threadsFlag.size(), threadsFlag) == 0) {
+      //digits only, as strtoul would take "-1" (or nothing at all)
+      const char* value = arg.c_str() + threadsFlag.size();
+      char* valueEnd;
+      threadCount = strtoul(value, &valueEnd, 10);
+      if (!isdigit((unsigned char)*value) || *valueEnd != '\0' ||
+          threadCount > kMaxThreads) {
+        cout << "bad thread count: " << arg << endl << usage << endl;
+        return 2;
+      }
+    } else if (arg == "--quiet") {
+      quiet = true;
+    } else if (arg == "-") {
+      string line;
+      while (getline(cin, line)) {
+        if (!line.empty()) fileNames.push_back(line);
+      }
+    } else {
+      fileNames.push_back(arg);
+    }
+  }
+  if (fileNames.empty()) {
+    cout << usage << endl;
+    return 2;
+  }
+
+  //the parser and the pendulums talk as they go, none of which is wanted here
+  ostream out(cout.rdbuf());
+  NullBuffer null;
+  cout.rdbuf(&null);
+
+  ThreadPool pool(threadCount);
+  vector<future<LintResult>> results;
+  double timeDelta = PendulumBase::timeDelta;
+  for (const string& fileName : fileNames) {
+    results.push_back(pool.Submit([fileName, timeDelta]() {
+      FileParser parser(fileName, timeDelta);
+      CountingSink sink;
+      bool opened = parser.Parse(sink);
+      return LintResult{opened, sink.count, move(parser.diagnostics)};
+    }));
+  }
+
+  size_t pendulums = 0, errors = 0, badFiles = 0, unopened = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    LintResult result = results[i].get();
+    if (!result.opened) {
+      ++unopened;
+      out << fileNames[i] << ": couldn't open file" << endl;
+      continue;
+    }
+    pendulums += result.pendulums;
+    if (result.diagnostics.empty()) continue;
+    ++badFiles;
+    errors += result.diagnostics.size();
+    if (quiet) continue;
+    for (const Diagnostic& diagnostic : result.diagnostics) {
+      out << diagnostic.ToString() << '\n';
+    }
+  }
+  cout.rdbuf(out.rdbuf());
+
+  cout << "harmlint: " << fileNames.size() << " files, " << pendulums
+       << " pendulums, " << errors << " errors in " << badFiles << " files";
+  if (unopened) cout << ", " << unopened << " couldn't be opened";
+  cout << endl;
+  return (errors || unopened) ? 1 : 0;
+}
@@ -7,23 +7,33 @@
 #include <gtkmm-3.0/gtkmm/scrolledwindow.h>
 #include <gtkmm-3.0/gtkmm/window.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <list>
 #include <map>
-#include <thread>
+#include <memory>
 #include <utility>
 #include <vector>
 
+#include "file_watcher.h"
+#include "latest_worker.h"
 #include "location.h"
+#include "mailbox.h"
 #include "pendulum.h"
 #include "pendulum_parser.h"
+#include "profiler.h"
+#include "range_index.h"
 #include "ringbuffer.h"
+#include "scene.h"
+#include "spatial_index.h"
 //#include "vimserver.h"
 
 using namespace std;
 using namespace pendulumNames;
+using namespace profilerNames;
 //using namespace vimserverNames;
 
 double defaultDelta = .01;
@@ -35,14 +45,16 @@ enum ProgramState { kRunning, kIdle, kStopped };
 ProgramState state = kStopped;
 ProgramState prevState;
 
-class PendulumDrawer;
-PendulumDrawer* lastClickedPendulum;
-PendulumDrawer* currentHighlightPendulum;
-
-class Harmonogram;
-bool UpdateHighlightPendulum(Harmonogram* harmonogram);
+//index of a PendulumDrawer in the Harmonogram
+typedef size_t DrawerHandle;
+const DrawerHandle kNoDrawer = (DrawerHandle)-1;
+DrawerHandle lastClickedPendulum = kNoDrawer;
 
 list<string> fileNameList;
+
+FrameProfiler profiler;
+//set with --profile=<prefix>, the frame times are dumped on exit
+string profileDumpPrefix;
 //
 
 /*
@@ -129,55 +141,68 @@ void ColorRainbow(Color& color, RainbowDirection& rainbowDirection, const double
  * evoloves through time.
  *
  * void Draw(context);
- * void Update();
+ * void Update(trails, handle); //records the pendulum's current position
+ * void IndexTrail(trails, handle); //adds every segment of the trail
+ * void UnindexTrail(trails, handle); //removes them again
  * Position GetCenter(); //returns by value!
  * PendulumBase* GetPendulum();
+ * void SetPendulum(pendulum); //the same pendulum, copied to a new place
  * void UpdateCenter(Position);
  *
- * void Resize(); //Resizes Ring buffer
+ * void Resize(); //Resizes Ring buffer, keeping the newest positions
+ * void KeepTrail(old); //takes over the newest positions of another drawer
  */
 class PendulumDrawer {
  public:
   enum Style { kPlain, kFade, kRainbow};
   RainbowDirection rainbowDirection;
 
-  PendulumDrawer(PendulumBase* pendulum) : pendulum_(pendulum), style_(kPlain) {
-    Update();
-    positionBuffer_.Fill(pendulum_->preferredBufferSize, pendulum_->position);
-    fadeFactor_ = exp2(log2(.05)/(double)positionBuffer_.buffer.size());
-    colorIncrement_ = pendulum_->GetCycles()/(double)positionBuffer_.buffer.size();
+  PendulumDrawer(PendulumBase* pendulum, size_t bufferSize,
+      BufferPool<Position>* pool = nullptr) :
+      pendulum_(pendulum), style_(kPlain) {
+    positionBuffer_.Fill(bufferSize, pendulum_->position, pool);
+    pushed_ = positionBuffer_.size();
+    fadeFactor_ = exp2(log2(.05)/(double)positionBuffer_.size());
+    colorIncrement_ = pendulum_->GetCycles()/(double)positionBuffer_.size();
     cout << "color increment: " << colorIncrement_ << endl;
   }
 
   void FadeDraw(const Cairo::RefPtr<Cairo::Context>& c) {
     Color startColor = pendulum_->color;
-    for (auto pos = positionBuffer_.end(); pos != positionBuffer_.begin(); ) {
-      c->move_to(pos->x, pos->y);
-      --pos;
+    //newest to oldest
+    for (size_t i = positionBuffer_.size(); i > 1; --i) {
+      const Position& from = positionBuffer_.Stored(i - 1);
+      const Position& to = positionBuffer_.Stored(i - 2);
+      c->move_to(from.x, from.y);
       c->set_source_rgba(startColor.R, startColor.G, startColor.B, startColor.A);
       ColorFade(startColor, fadeFactor_);
-      c->line_to(pos->x, pos->y);
+      c->line_to(to.x, to.y);
       c->stroke();
     }
   }
 
   void PlainDraw(const Cairo::RefPtr<Cairo::Context>& c) {
     Color startColor = pendulum_->color;
-    c->move_to(positionBuffer_.front().x, positionBuffer_.front().y);
+    const Position& front = positionBuffer_.Stored(0);
+    c->move_to(front.x, front.y);
     c->set_source_rgba(startColor.R, startColor.G, startColor.B, startColor.A);
-    for (auto pos : positionBuffer_) c->line_to(pos.x, pos.y);
+    for (const auto& span : positionBuffer_.Spans()) {
+      for (const Position& pos : span) c->line_to(pos.x, pos.y);
+    }
     c->stroke();
   }
 
   void RainbowDraw(const Cairo::RefPtr<Cairo::Context>& c) {
     Color startColor = pendulum_->color;
     RainbowDirection startDirection = rainbowDirection;
-    for (auto pos = positionBuffer_.begin(); pos != positionBuffer_.end(); ) {
-      c->move_to(pos->x, pos->y);
-      ++pos;
+    //oldest to newest
+    for (size_t i = 1; i < positionBuffer_.size(); ++i) {
+      const Position& from = positionBuffer_.Stored(i - 1);
+      const Position& to = positionBuffer_.Stored(i);
+      c->move_to(from.x, from.y);
       c->set_source_rgba(startColor.R, startColor.G, startColor.B, startColor.A);
       ColorRainbow(startColor, startDirection, colorIncrement_);
-      c->line_to(pos->x, pos->y);
+      c->line_to(to.x, to.y);
       c->stroke();
     } 
     ColorRainbow(pendulum_->color, rainbowDirection, colorIncrement_);
@@ -191,40 +216,97 @@ class PendulumDrawer {
     UpdateCenterColor();
   }
 
+  /*
+   * The trail is drawn from the stored positions, with the buffer's lazy
+   * offset applied once as a translation of the context.
+   */
   void Draw(const Cairo::RefPtr<Cairo::Context>& c) {
     c->save();
     c->set_line_width(3);
+    c->translate(positionBuffer_.Offset().x, positionBuffer_.Offset().y);
     switch (state) {
       case kRunning :
         switch (style_) {
-          case kPlain : PlainDraw(c); break;
-          case kFade : FadeDraw(c); break;
-          case kRainbow: RainbowDraw(c);
+          case kPlain : {
+            ProfileScope scope(profiler, FrameProfiler::kPlainDraw);
+            PlainDraw(c);
+          } break;
+          case kFade : {
+            ProfileScope scope(profiler, FrameProfiler::kFadeDraw);
+            FadeDraw(c);
+          } break;
+          case kRainbow : {
+            ProfileScope scope(profiler, FrameProfiler::kRainbowDraw);
+            RainbowDraw(c);
+          }
         } break;
       case kIdle : 
-      case kStopped :
+      case kStopped : {
+        ProfileScope scope(profiler, FrameProfiler::kPlainDraw);
         PlainDraw(c); 
-        CenterDraw(c); break;
+      } break;
     }
     c->restore();
+    if (state != kRunning) {
+      ProfileScope scope(profiler, FrameProfiler::kCenterDraw);
+      CenterDraw(c);
+    }
+  }
+
+  /*
+   * The segment between the i-th and (i-1)-th positions of the buffer is
+   * indexed as pushed_ - size + i, so a push drops the oldest segment from the
+   * grid and adds the one to the new position, without touching the rest.
+   */
+  void Update(SegmentGrid& trails, DrawerHandle handle) {
+    size_t size = positionBuffer_.size();
+    if (size > 1) {
+      trails.Remove(handle, SegmentSeq(1), positionBuffer_[0], positionBuffer_[1]);
+      trails.Insert(handle, pushed_, positionBuffer_.back(), pendulum_->position);
+    }
+    Push(pendulum_->position);
+  }
+
+  void IndexTrail(SegmentGrid& trails, DrawerHandle handle) const {
+    for (size_t i = 1; i < positionBuffer_.size(); ++i) {
+      trails.Insert(handle, SegmentSeq(i),
+          positionBuffer_[i - 1], positionBuffer_[i]);
+    }
   }
 
-  void Update() {
-    pendulum_->UpdatePosition();
-    positionBuffer_.Push(pendulum_->position);
+  void UnindexTrail(SegmentGrid& trails, DrawerHandle handle) const {
+    for (size_t i = 1; i < positionBuffer_.size(); ++i) {
+      trails.Remove(handle, SegmentSeq(i),
+          positionBuffer_[i - 1], positionBuffer_[i]);
+    }
   }
 
   Position GetCenter() { return pendulum_->center; }
-  PendulumBase* GetPendulum() { return pendulum_; }
+  PendulumBase* GetPendulum() const { return pendulum_; }
+  void SetPendulum(PendulumBase* pendulum) { pendulum_ = pendulum; }
   
+  //O(1), the trail is only moved by the buffer's offset
   void UpdateCenter(double x, double y) {
     positionBuffer_.Translate(TranslateCenter(*pendulum_, x, y));
   }
   
   //This is mainly for the case that the pendulum_ is for a compound pendulum
-  void Resize(size_t size) { positionBuffer_.Fill(size, pendulum_->center); }
+  void Resize(size_t size, BufferPool<Position>* pool = nullptr) {
+    positionBuffer_.Resize(size, pool);
+    fadeFactor_ = exp2(log2(.05)/(double)positionBuffer_.size());
+    colorIncrement_ = pendulum_->GetCycles()/(double)positionBuffer_.size();
+  }
+
+  //so that a reloaded pendulum doesn't start its trail from scratch
+  void KeepTrail(const PendulumDrawer& old) {
+    size_t keep = min(positionBuffer_.size(), old.positionBuffer_.size());
+    for (size_t i = old.positionBuffer_.size() - keep;
+        i < old.positionBuffer_.size(); ++i) {
+      Push(old.positionBuffer_[i]);
+    }
+  }
 
-  string Name() { return pendulum_->name; }
+  string Name() const { return pendulum_->name; }
 
   void NextStyle() {
     switch (style_) {
@@ -238,29 +320,68 @@ class PendulumDrawer {
   }
 
  private:
+  void Push(const Position& position) {
+    positionBuffer_.Push(position);
+    ++pushed_;
+  }
+
+  uint32_t SegmentSeq(size_t i) const {
+    return (uint32_t)(pushed_ - positionBuffer_.size() + i);
+  }
+
   PendulumBase* pendulum_;
   RingBuffer<Position> positionBuffer_;
+  //positions pushed so far, wraps around along with the segment numbers
+  uint32_t pushed_;
   double fadeFactor_;
   double colorIncrement_;
   Style style_;
 };
 
 /*
- * The Worker class for the program.  Holds a list of PendulumBases and reacts
+ * The Worker class for the program.  Holds a Scene of pendulums and reacts
  * to events to maintain them.  The events are clearly seen at the beginning of
  * the default constructor.
  *
  * string PrintData();
  * bool CheckForPendulumAt(x,y); 
  *      //returns true when a pendulum's center is close enough to x,y
- * void Initialize();
+ * DrawerHandle PendulumAt(x,y); //the pendulum with the closest trail or center
+ * void MovePendulum(handle, x, y); //moves the center, and its trail
+ * PendulumDrawer& Drawer(handle);
+ * void Initialize(); //makes the drawers for the freshly parsed scene
  * void ReRead(); //reparses the input files, resets all pendulums
- * void UpdateAll(); //calls Update on all pendulumDrawers
+ * void Reload(file, parsed); //replaces what was edited in one file
+ * void ScaleTrails(factor); //resizes every trail, keeping what is drawn
+ * void UpdateAll(); //steps the scene, then calls Update on all drawers
+ *
+ * The pendulums live in one of two Scenes, and the drawers (one per pendulum,
+ * in the scene's order) in one of two vectors.  ReRead parses into the idle
+ * Scene and fills the idle vector, so the old drawers can still be read while
+ * the new ones are made, and then clears the old ones.  Clearing keeps the
+ * capacity, so a reload is an arena reset rather than a free per pendulum.
+ * The drawers' RingBuffers likewise live in one of two BufferPools.
+ *
+ * The input files are watched, and one that is saved is reparsed on the
+ * FileWatcher's thread.  The result is picked up by on_timeout, and only the
+ * pendulums whose text changed are replaced (see Reload).
  *
+ * The centers are kept in a PointGrid, and the trails' segments in a
+ * SegmentGrid, so that finding the pendulum under the mouse (on every motion
+ * event, for the hover highlight) doesn't look at every pendulum.  The
+ * SegmentGrid follows the trails as they are pushed, except for the one that
+ * is being dragged, which is put back when it is dropped (and which
+ * IndexTrails leaves out, should the trails be resized in the meantime).  The pendulums'
+ * source ranges are kept in a RangeIndex, for the one under vim's cursor.
+ *
+ * vim's cursor is asked for by a LatestWorker, so the UI never waits for the
+ * editor: a key press only posts the query (replacing one that hasn't been
+ * sent yet), and on_draw picks up the answer whenever it comes.
  */
 class Harmonogram : public Gtk::DrawingArea {
  public:
-  Harmonogram()  /*: vimServer("Harmonogram")*/ {
+  Harmonogram() : centerGrid_(kCenterTolerance), trailGrid_(kTrailCellSize)
+                  /*, vimServer("Harmonogram")*/ {
     //signals
 
     //time evolution
@@ -285,66 +406,282 @@ class Harmonogram : public Gtk::DrawingArea {
     
     //Set up structures from reading the input file
     ReRead();
+    fileNames_.assign(fileNameList.begin(), fileNameList.end());
+    //not timeDelta, which is 0 while a pendulum is being dragged
+    double nominalDelta = harmonogramParser_.timeDelta;
+    watcher_ = make_unique<FileWatcher>(fileNames_,
+        [this, nominalDelta](size_t file) {
+          reloads_.Post(make_pair(file,
+              ParseFile(fileNames_[file], nominalDelta)));
+        });
     //vimServer.SetFileNameList(fileNameList);
     //vimServer.Activate();
   }
 
   void PrintData() {
-    for (const auto& pendulumPtr : pendulumList_) {
-      cout << pendulumPtr->ToString() << endl;
+    for (PendulumHandle handle : scene_.Handles()) {
+      cout << scene_[handle].ToString() << endl;
     }
   } 
 
   void ReRead() {
-    pendulumList_.clear();
-    pendulumDrawerList_.clear();
-    pendulumList_ = ::std::move(harmonogramParser_.Parse(fileNameList));
+    oldScene_.swap(scene_);
+    harmonogramParser_.Parse(fileNameList, scene_);
+    fileStarts_ = harmonogramParser_.fileStarts;
     Initialize();
   }
 
-  void UpdateHP() {
-    static thread* old_thread = nullptr;
-    thread* tp = new thread(UpdateHighlightPendulum, this);
-    if (old_thread) old_thread->join();
-    old_thread = tp;
+  /*
+   * Replaces the pendulums of one file with those just parsed from it.  The
+   * ones whose text (block hash) didn't change are kept as they are: their
+   * phase, dragged center, trail and style.  The other files' pendulums
+   * aren't touched.
+   */
+  void Reload(size_t file, ParsedFile parsed) {
+    cout << "reloading: " << fileNames_[file] << endl << parsed.log;
+    for (const auto& diagnostic : parsed.diagnostics) {
+      cout << diagnostic.ToString() << endl;
+    }
+    if (!parsed.opened) {
+      cout << "couldn't open file: " << fileNames_[file] << endl;
+      return;
+    }
+    map<PendulumId, uint64_t>& hashes = harmonogramParser_.blockHashes;
+    map<PendulumId, Range>& locations = harmonogramParser_.locationMap;
+    size_t begin = fileStarts_[file];
+    size_t end = fileStarts_[file + 1];
+
+    //the file's old drawers, by name, for the pendulums that weren't edited
+    map<string, DrawerHandle> kept;
+    for (DrawerHandle h = begin; h < end; ++h) {
+      string name = drawers_[h].Name();
+      auto hash = parsed.blockHashes.find(name);
+      if (hash != parsed.blockHashes.end() && hashes.count(name) &&
+          hashes[name] == hash->second) {
+        kept[name] = h;
+      }
+      hashes.erase(name);
+      locations.erase(name);
+    }
+    for (auto& p : parsed.locationMap) locations[p.first] = move(p.second);
+    for (auto& p : parsed.blockHashes) hashes[p.first] = p.second;
+
+    //the other files' pendulums are copied as they are
+    oldScene_.Clear();
+    oldScene_.AppendCopy(scene_, 0, begin);
+    size_t freshBegin = oldScene_.size();
+    oldScene_.Append(move(parsed.scene));
+    size_t freshEnd = oldScene_.size();
+    oldScene_.AppendCopy(scene_, end, scene_.size());
+    const vector<PendulumHandle>& handles = oldScene_.Handles();
+    for (size_t i = freshBegin; i < freshEnd; ++i) {
+      auto old = kept.find(oldScene_[handles[i]].name);
+      if (old == kept.end()) continue;
+      PendulumHandle from = scene_.Handles()[old->second];
+      if (from.kind == handles[i].kind) {
+        oldScene_.Replace(handles[i], scene_, from);
+      } else {
+        kept.erase(old);
+      }
+    }
+    if (!oldScene_.Link()) {
+      for (const auto& diagnostic : CycleDiagnostics(oldScene_, locations)) {
+        cout << diagnostic.ToString() << endl;
+      }
+    }
+    for (size_t i = file + 1; i < fileStarts_.size(); ++i) {
+      fileStarts_[i] = fileStarts_[i] + freshEnd - end;
+    }
+
+    //the kept drawers move over, the others are made anew
+    oldDrawers_.swap(drawers_);
+    drawers_.clear();
+    drawers_.reserve(oldScene_.size());
+    for (size_t i = 0; i < handles.size(); ++i) {
+      PendulumBase& pendulum = oldScene_[handles[i]];
+      DrawerHandle old = kNoDrawer;
+      if (i < freshBegin) {
+        old = i;
+      } else if (i >= freshEnd) {
+        old = i - freshEnd + end;
+      } else if (kept.count(pendulum.name)) {
+        old = kept[pendulum.name];
+      }
+      if (old != kNoDrawer) {
+        drawers_.push_back(move(oldDrawers_[old]));
+        drawers_.back().SetPendulum(&pendulum);
+      } else {
+        //a file's compound comes after its simple pendulums
+        pendulum.UpdatePosition();
+        drawers_.emplace_back(&pendulum, TrailSize(pendulum));
+        cout << pendulum.ToString() << endl;
+      }
+    }
+    scene_.swap(oldScene_);
+    oldScene_.Clear();
+    oldDrawers_.clear();
+    ResetIndexes();
+  }
+
+  void ScaleTrails(double factor) {
+    trailScale_ *= factor;
+    size_t poolSize = 0;
+    for (const auto& p : drawers_) {
+      poolSize += NextPowerOfTwo(TrailSize(*p.GetPendulum()));
+    }
+    BufferPool<Position>& pool = NextPool(poolSize);
+    for (auto& p : drawers_) p.Resize(TrailSize(*p.GetPendulum()), &pool);
+    IndexTrails();
+  }
+
+  PendulumDrawer& Drawer(DrawerHandle handle) {
+    assert(handle < drawers_.size());
+    return drawers_[handle];
   }
 
-  friend bool UpdateHighlightPendulum(Harmonogram*);
+  //the innermost pendulum whose text location is in, or kNoDrawer
+  DrawerHandle PendulumAt(const Location& location) const {
+    size_t id = rangeIndex_.Innermost(location);
+    return (id == RangeIndex::kNone) ? kNoDrawer : id;
+  }
+
+  //asks for vim's cursor, the pendulum under it is highlighted by on_draw
+  void UpdateHP() {
+    cursorSync_.Post([this]() {
+        Location cursor;
+        //vimServer.GetCursor(cursor);
+        return cursor;
+      });
+  }
  private:
+  static constexpr double kCenterTolerance = 15;
+  static constexpr double kTrailTolerance = 5;
+  static constexpr double kTrailCellSize = 16;
+
   bool CheckForPendulumAt(double x, double y) {
-    static const double tolerance = 15;
-    for (auto& p : pendulumDrawerList_) {
-      if (Norm(p.GetPendulum()->center - Position{x,y}) < tolerance) {
-        lastClickedPendulum = &p;
-        return true;
-      }
+    DrawerHandle handle = PendulumAt(x, y);
+    if (handle == kNoDrawer) return false;
+    lastClickedPendulum = handle;
+    return true;
+  }
+
+  //the curves are easier to tell apart than the centers, so they go first
+  DrawerHandle PendulumAt(double x, double y) const {
+    size_t id = trailGrid_.Nearest(Position{x,y}, kTrailTolerance);
+    if (id != SegmentGrid::kNone) return id;
+    id = centerGrid_.Nearest(Position{x,y}, kCenterTolerance);
+    return (id == PointGrid::kNone) ? kNoDrawer : id;
+  }
+
+  void MovePendulum(DrawerHandle handle, double x, double y) {
+    Drawer(handle).UpdateCenter(x, y);
+    centerGrid_.Move(handle, Position{x,y});
+  }
+
+  //the pendulum being dragged, whose trail is indexed when it is dropped
+  DrawerHandle Dragged() const {
+    return (state == kIdle) ? lastClickedPendulum : kNoDrawer;
+  }
+
+  //all but the dragged one's, which on_button_release_event adds
+  void IndexTrails() {
+    trailGrid_.Clear();
+    DrawerHandle dragged = Dragged();
+    for (DrawerHandle h = 0; h < drawers_.size(); ++h) {
+      if (h != dragged) drawers_[h].IndexTrail(trailGrid_, h);
     }
-    return false;
   }
 
+  /*
+   * Makes a drawer for every pendulum in scene_.  A drawer that replaces one
+   * with the same name keeps its trail.
+   */
   void Initialize() {
     state = kRunning;
-    for (PendulumPtr& pendulumPtr : pendulumList_) {
-      pendulumDrawerList_.emplace_back(pendulumPtr.get());
-      cout << pendulumPtr->ToString() << endl;
+    size_t poolSize = 0;
+    for (PendulumHandle handle : scene_.Handles()) {
+      poolSize += NextPowerOfTwo(TrailSize(scene_[handle]));
+    }
+    BufferPool<Position>& pool = NextPool(poolSize);
+
+    //sorted by name, to find the old trails
+    oldDrawers_.swap(drawers_);
+    oldNames_.clear();
+    for (DrawerHandle h = 0; h < oldDrawers_.size(); ++h) {
+      oldNames_.emplace_back(&oldDrawers_[h].GetPendulum()->name, h);
+    }
+    auto byName = [](const pair<const string*, DrawerHandle>& l,
+        const pair<const string*, DrawerHandle>& r) { return *l.first < *r.first; };
+    sort(oldNames_.begin(), oldNames_.end(), byName);
+
+    //the drawers start from the pendulums' first positions
+    scene_.UpdatePositions();
+    drawers_.clear();
+    drawers_.reserve(scene_.size());
+    for (PendulumHandle handle : scene_.Handles()) {
+      PendulumBase& pendulum = scene_[handle];
+      drawers_.emplace_back(&pendulum, TrailSize(pendulum), &pool);
+      pair<const string*, DrawerHandle> key(&pendulum.name, kNoDrawer);
+      auto old = lower_bound(oldNames_.begin(), oldNames_.end(), key, byName);
+      if (old != oldNames_.end() && *old->first == pendulum.name) {
+        drawers_.back().KeepTrail(oldDrawers_[old->second]);
+      }
+      cout << pendulum.ToString() << endl;
+    }
+
+    ResetIndexes();
+    oldDrawers_.clear();
+    oldScene_.Clear();
+  }
+
+  //after the drawers have been replaced, nothing points to the old ones
+  void ResetIndexes() {
+    //a drag is dropped, so that every trail is indexed
+    lastClickedPendulum = kNoDrawer;
+    highlightPendulum_ = kNoDrawer;
+    hoverPendulum_ = kNoDrawer;
+
+    centerGrid_.Clear();
+    for (DrawerHandle h = 0; h < drawers_.size(); ++h) {
+      centerGrid_.Insert(h, drawers_[h].GetCenter());
+    }
+    IndexTrails();
+    IndexRanges();
+  }
+
+  void IndexRanges() {
+    const map<PendulumId, Range>& locations = harmonogramParser_.locationMap;
+    rangeIndex_.Clear();
+    for (DrawerHandle h = 0; h < drawers_.size(); ++h) {
+      auto range = locations.find(drawers_[h].Name());
+      if (range != locations.end()) rangeIndex_.Insert(h, range->second);
     }
+    rangeIndex_.Build();
+  }
+
+  size_t TrailSize(const PendulumBase& pendulum) const {
+    return max<size_t>(1, (size_t)round(trailScale_*pendulum.preferredBufferSize));
+  }
+
+  BufferPool<Position>& NextPool(size_t size) {
+    currentPool_ ^= 1;
+    bufferPools_[currentPool_].Reset(size);
+    return bufferPools_[currentPool_];
   }
 
   /*
    * gets the gvim stuff going...
    */
-  string lastHighlighted;
   void VimGotoPendulum() {
     cout << __func__ << endl;
-    if (!lastClickedPendulum) return;
-    cout << "last clicked pendulum: " << lastClickedPendulum->Name() << endl;
+    if (lastClickedPendulum == kNoDrawer) return;
+    string name = Drawer(lastClickedPendulum).Name();
+    cout << "last clicked pendulum: " << name << endl;
     //vimServer.SetCursor(
-        //harmonogramParser_.locationMap[lastClickedPendulum->Name()].begin);
-    //if (lastHighlighted != "") {
-      //vimServer.UnHighlightPattern(lastHighlighted);
-    //}
-    lastHighlighted = lastClickedPendulum->Name();
-    //vimServer.HighlightPattern(lastHighlighted);
+        //harmonogramParser_.locationMap[name].begin);
+    //only the clicked one stays highlighted
+    //vimServer.SetHighlightedRanges(
+        //{harmonogramParser_.locationMap[name]});
   }
 
     bool on_button_press_event(GdkEventButton* button) {
@@ -354,13 +691,19 @@ class Harmonogram : public Gtk::DrawingArea {
     if (CheckForPendulumAt(button->x, button->y)) {
       cout << "button: " << button->button << endl;
       switch (button->button) {
-        case 1 :
-          lastClickedPendulum->NextStyle();
+        case 1 : {
+          PendulumDrawer& drawer = Drawer(lastClickedPendulum);
+          drawer.NextStyle();
+          //the trail may have been grabbed away from the center
+          Position center = drawer.GetCenter();
+          grabOffset_ = Position{center.x - button->x, center.y - button->y};
+          drawer.UnindexTrail(trailGrid_, lastClickedPendulum);
           prevState = state;
           //stop time!
           timeDelta = 0;
           state = kIdle;
-          return true; break;
+          return true;
+        } break;
         case 2 : return false; break;
         /*case 3 : if (!vimServer.CheckServer()) vimServer.Activate();
                  vimServer.setNormal = vimServer.SetNormalMode();
@@ -378,6 +721,9 @@ class Harmonogram : public Gtk::DrawingArea {
   bool on_button_release_event(GdkEventButton* button) {
     switch (state) {
       case kIdle: //start time!
+        if (lastClickedPendulum != kNoDrawer) {
+          Drawer(lastClickedPendulum).IndexTrail(trailGrid_, lastClickedPendulum);
+        }
         timeDelta = defaultDelta;
         state = prevState; break;
       default:
@@ -386,49 +732,142 @@ class Harmonogram : public Gtk::DrawingArea {
     return true;
   }
 
-  const double waitPeriod = 2; //seconds
-  double curTime = 0;
-
   bool on_draw(const Cairo::RefPtr<Cairo::Context>& c) {
-    for (PendulumDrawer& p : pendulumDrawerList_) p.Draw(c);
-    //if (!vimServer.IsActive()) return true;
-    if (currentHighlightPendulum)
-      currentHighlightPendulum->CenterDraw(c);
+    profiler.MarkDrawStart();
+    {
+      ProfileScope scope(profiler, FrameProfiler::kDraw);
+      for (PendulumDrawer& p : drawers_) p.Draw(c);
+      //only the newest cursor matters
+      for (const Location& cursor : cursorSync_.TakeAll()) {
+        highlightPendulum_ = PendulumAt(cursor);
+      }
+      //if (!vimServer.IsActive()) return true;
+      if (highlightPendulum_ != kNoDrawer)
+        Drawer(highlightPendulum_).CenterDraw(c);
+      //the centers are already drawn unless it is running
+      if (hoverPendulum_ != kNoDrawer && state == kRunning)
+        Drawer(hoverPendulum_).CenterDraw(c);
+    }
+    if (profiler.showOverlay) DrawProfilerOverlay(c);
+    profiler.EndFrame();
     return true;
   }
 
+  /*
+   * Draws a histogram of the frame times in the top left corner, with the
+   * percentiles of the main sections written underneath it.
+   */
+  void DrawProfilerOverlay(const Cairo::RefPtr<Cairo::Context>& c) {
+    static const size_t bins = 40;
+    static const double maxMs = 4*1000*defaultDelta;
+    static const double width = 240, height = 80, margin = 10, lineHeight = 14;
+    static const FrameProfiler::Section sections[] = {
+      FrameProfiler::kFrame, FrameProfiler::kUpdate,
+      FrameProfiler::kQueueDraw, FrameProfiler::kDraw
+    };
+    //sized once, Histogram() only fills it
+    static vector<size_t> histogram(bins);
+    profiler.Histogram(FrameProfiler::kFrame, maxMs, histogram);
+    size_t maxCount = 1;
+    for (size_t count : histogram) maxCount = max(maxCount, count);
+
+    c->save();
+    c->set_source_rgba(0, 0, 0, .6);
+    size_t lineCount = 2 + sizeof(sections)/sizeof(*sections);
+    c->rectangle(margin, margin, width + 2*margin, 
+        height + lineCount*lineHeight + 2*margin);
+    c->fill();
+    c->set_source_rgba(.4, .9, .4, .9);
+    double barWidth = width/bins;
+    for (size_t i = 0; i < bins; ++i) {
+      double barHeight = height*histogram[i]/maxCount;
+      c->rectangle(2*margin + i*barWidth, 2*margin + height - barHeight,
+          barWidth - 1, barHeight);
+    }
+    c->fill();
+    c->set_source_rgba(1, 1, 1, .9);
+    c->set_font_size(11);
+    double y = 2*margin + height + lineHeight;
+    c->move_to(2*margin, y);
+    c->show_text("frame time, 0 - " + to_string((int)maxMs) + " ms");
+    for (FrameProfiler::Section section : sections) {
+      char line[128];
+      snprintf(line, sizeof(line), "%-10s p50 %6.2f  p90 %6.2f  p99 %6.2f",
+          FrameProfiler::SectionName(section),
+          profiler.Percentile(section, .5), profiler.Percentile(section, .9),
+          profiler.Percentile(section, .99));
+      y += lineHeight;
+      c->move_to(2*margin, y);
+      c->show_text(line);
+    }
+    c->restore();
+  }
+
   bool on_motion_notify_event(GdkEventMotion* motion) {
     switch(state) {
       case kIdle :
-        if (!lastClickedPendulum) return false;
-        lastClickedPendulum->UpdateCenter(motion->x, motion->y); break;
+        if (lastClickedPendulum == kNoDrawer) return false;
+        MovePendulum(lastClickedPendulum, motion->x + grabOffset_.x,
+            motion->y + grabOffset_.y);
+        break;
       default :
+        hoverPendulum_ = PendulumAt(motion->x, motion->y);
         return false;
     }
     return true;
   }
 
   bool on_timeout() {
+    for (auto& reload : reloads_.TakeAll()) {
+      Reload(reload.first, move(reload.second));
+    }
     switch (state) {
-      case kRunning :
+      case kRunning : {
+        ProfileScope scope(profiler, FrameProfiler::kUpdate);
         UpdateAll();
-        break;
+      } break;
       case kIdle :
       case kStopped :
         break;
     }
+    profiler.MarkQueueDraw();
     queue_draw();
     return true;
   }
 
   void UpdateAll() {
-    for (auto& p : pendulumDrawerList_) p.Update();
+    scene_.UpdatePositions();
+    for (DrawerHandle h = 0; h < drawers_.size(); ++h) {
+      drawers_[h].Update(trailGrid_, h);
+    }
   }
 
   HarmonogramParser harmonogramParser_;
-  list<PendulumPtr> pendulumList_;
-  list<PendulumDrawer> pendulumDrawerList_;
+  Scene scene_;
+  Scene oldScene_;
+  vector<PendulumDrawer> drawers_;
+  vector<PendulumDrawer> oldDrawers_;
+  vector<pair<const string*, DrawerHandle>> oldNames_;
+  PointGrid centerGrid_;
+  SegmentGrid trailGrid_;
+  RangeIndex rangeIndex_;
+  Position grabOffset_ = {0, 0};
+  DrawerHandle hoverPendulum_ = kNoDrawer;
+  //the pendulum under vim's cursor
+  DrawerHandle highlightPendulum_ = kNoDrawer;
+  BufferPool<Position> bufferPools_[2];
+  size_t currentPool_ = 0;
+  double trailScale_ = 1;
+  vector<string> fileNames_;
+  //where each file's pendulums start in scene_, as in HarmonogramParser
+  vector<size_t> fileStarts_;
+  //(file, what it was reparsed into)
+  Mailbox<pair<size_t, ParsedFile>> reloads_;
+  //last, so that it stops before the rest goes away
+  unique_ptr<FileWatcher> watcher_;
   //VimServer vimServer;
+  //after what it uses, so that it stops first
+  LatestWorker<Location> cursorSync_;
 };
 
 /*
@@ -437,6 +876,8 @@ class Harmonogram : public Gtk::DrawingArea {
  * <space> : switch from RUNNING mode to IDLE.
  *  Basically pauses motion while dragging pendulums around
  * <r> : ReRead the input files.
+ * <p> : toggle the frame time overlay.
+ * <+>/<-> : make all of the trails twice/half as long.
  */
 class MyWindow : public Gtk::Window {
  public:
@@ -481,6 +922,15 @@ class MyWindow : public Gtk::Window {
     } else if (key->keyval == GDK_KEY_h) {
       harmonogram_.UpdateHP();
       return true;
+    } else if (key->keyval == GDK_KEY_p) {
+      profiler.showOverlay = !profiler.showOverlay;
+      return true;
+    } else if (key->keyval == GDK_KEY_plus) {
+      harmonogram_.ScaleTrails(2);
+      return true;
+    } else if (key->keyval == GDK_KEY_minus) {
+      harmonogram_.ScaleTrails(.5);
+      return true;
     }
     return false;
   }
@@ -494,54 +944,19 @@ class MyWindow : public Gtk::Window {
   }
 };
 
-bool UpdateHighlightPendulum(Harmonogram* harmonogram) {
-  Location curPos;
-  PendulumDrawer* harmPtr = nullptr;
-  //curTime += timeDelta;
-  //if (curTime < waitPeriod) return false;
-  //curTime -= waitPeriod;
-  /* if the cursor is successfully loaded from the vimServer, then
-   * find the PendulumId which corresponds to the Range which contains
-   * that cursor Postion (if it exists), then find which PendulumDrawer
-   * has a pendulum_ which has the same PendulumID, if it exists, then
-   * set this as the currentHighlightPendulum, so that it's center can
-   * be drawn.
-   */
-  //map<PendulumId,Range>::value_type* val = nullptr;
-  /*if (harmonogram->vimServer.GetCursor(curPos)) {
-    for (auto& p : harmonogram->harmonogramParser_.locationMap) 
-      if (p.second.InRange(curPos)) 
-        for (auto& pDrawer : harmonogram->pendulumDrawerList_) {
-          if (!val && pDrawer.Name() == p.first) {
-            currentHighlightPendulum = &pDrawer;
-            val = &p;
-            cout << "curPtr: " << pDrawer.Name() << endl;
-          } else if (val && pDrawer.Name() == p.first) {
-            if (val->second.IsSubrange(p.second)) {
-              currentHighlightPendulum = &pDrawer;
-              cout << "setting curHPend: " << pDrawer.Name() << endl;
-            }
-            return true;
-          }
-        }
-  }*/
-  if (harmPtr) {
-    currentHighlightPendulum = harmPtr;
-    cout << "current set: " << currentHighlightPendulum->Name() << endl;
-    return true;
-  }
-  cout << "currentHighlightPendulum not set!" << endl;
-  currentHighlightPendulum = nullptr;
-  return false;
-}
-
 int main(int argc, char** argv) {
   timeDelta = defaultDelta;
 
-  if (argc > 1) {
-    for (int i = 1; i < argc; ++i) 
-      fileNameList.push_back(argv[i]);
-  } else {
+  const string profileFlag = "--profile=";
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg.compare(0, profileFlag.size(), profileFlag) == 0) {
+      profileDumpPrefix = arg.substr(profileFlag.size());
+    } else {
+      fileNameList.push_back(arg);
+    }
+  }
+  if (fileNameList.empty()) {
     cout << "please enter input files" << endl;
     return 0;
   }
@@ -550,4 +965,9 @@ int main(int argc, char** argv) {
       
   MyWindow window;
   app->run(window);
+
+  if (profileDumpPrefix != "") {
+    profiler.DumpCsv(profileDumpPrefix + ".csv");
+    profiler.DumpJson(profileDumpPrefix + ".json");
+  }
 }
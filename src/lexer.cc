@@ -0,0 +1,94 @@
+#include "lexer.h"
+
+#include <cctype>
+#include <list>
+#include <string>
+#include <utility>
+
+#include "trie.h"
+
+using namespace pendulumNames;
+using namespace std;
+
+const list<pair<TokenName, string>>& pendulumNames::GetTokenList() {
+  static const list<pair<TokenName, string>> tokenList {
+    {kTokAmplitude, "amplitude:"},
+    {kTokCenter, "center:"},
+    {kTokColor, "color:"},
+    {kTokComma, ","},
+    {kTokCommentBegin, "/*"},
+    {kTokCommentEnd, "*/"},
+    {kTokCycles, "cycles:"},
+    {kTokDirection, "direction:"},
+    {kTokFrequency, "frequency:"},
+    {kTokName, "name:"},
+    {kTokOscillation, "oscillation"},
+    {kTokPendulumBegin, "{"},
+    {kTokPendulumEnd, "}"},
+    {kTokRotation, "rotation"},
+    {kTokStartPhase, "startphase:"},
+    {kTokType, "type:"}
+  };
+  return tokenList;
+}
+
+namespace {
+
+//the tokens, compiled once
+const TokenDfa& Tokens() {
+  static const TokenDfa dfa = []() {
+    Trie trie;
+    for (const auto& p : GetTokenList()) trie.Insert(p.second, p.first);
+    return trie.Compile();
+  }();
+  return dfa;
+}
+
+}; //namespace
+
+TokenName pendulumNames::SliceToTokenName(const StringSlice& slice) {
+  const TokenDfa& dfa = Tokens();
+  TokenDfa::State state = TokenDfa::kStart;
+  for (char c : slice) state = dfa.Next(state, c);
+  if (dfa.Length(state) != slice.size) return kTokInvalid;
+  return (TokenName)dfa.Accept(state);
+}
+
+Lexer::Lexer(const char* begin, const char* end) : begin_(begin), cur_(begin),
+    end_(end), atEnd_(false),
+    numberStatus_(kDecimalOk), token_(kTokInvalid), tokenText_{begin, 0} {}
+
+TokenName Lexer::Next() {
+  const TokenDfa& dfa = Tokens();
+  TokenDfa::State state = TokenDfa::kStart;
+  while (cur_ < end_) {
+    state = dfa.Next(state, *cur_++);
+    int token = dfa.Accept(state);
+    if (token != TokenDfa::kNoToken) {
+      tokenText_ = StringSlice{cur_ - dfa.Length(state), dfa.Length(state)};
+      return token_ = (TokenName)token;
+    }
+  }
+  atEnd_ = true;
+  tokenText_ = StringSlice{cur_, 0};
+  return token_ = kTokInvalid;
+}
+
+bool Lexer::ReadDouble(double& d) {
+  SkipSpace();
+  DecimalResult result = ParseDecimal(cur_, end_, d);
+  numberStatus_ = result.status;
+  cur_ = result.end;
+  return result.status == kDecimalOk;
+}
+
+StringSlice Lexer::ReadIdentifier() {
+  SkipSpace();
+  const char* start = cur_;
+  while (cur_ < end_ && isalnum((unsigned char)*cur_)) ++cur_;
+  return StringSlice{start, (size_t)(cur_ - start)};
+}
+
+void Lexer::SkipSpace() {
+  while (cur_ < end_ && isspace((unsigned char)*cur_)) ++cur_;
+}
@@ -1,26 +1,30 @@
 #include "location.h"
 
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <list>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.h"
 
 using namespace std;
 
-string Location::ToString() const {
-  return fileName + ":" + std::to_string(line) + ":" + std::to_string(column);
-}
+const string& Location::FileName() const { return Sources().FileName(file); }
+
+size_t Location::Line() const { return Sources().Line(file, offset); }
+
+size_t Location::Column() const { return Sources().Column(file, offset); }
 
-void Location::Reset() {
-  fileName = "";
-  line = 1;
-  column = 1;
+string Location::ToString() const {
+  return FileName() + ":" + std::to_string(Line()) + ":" +
+      std::to_string(Column());
 }
 
 bool Location::operator<=(const Location& rhs) const {
-  cout << ToString() << " <= " << rhs.ToString() << endl;
-  return (fileName == rhs.fileName &&
-            (line < rhs.line || 
-            (line == rhs.line && column <= rhs.column)));
+  return file == rhs.file && offset <= rhs.offset;
 }
 
 bool Range::InRange(const Location& where) const {
@@ -34,7 +38,8 @@ bool Range::IsSubrange(const Range& range) const {
 std::list<size_t> Range::Lines() const {
   std::list<size_t> lines;
   if (Valid()) {
-    for (size_t l = begin.line; l <= end.line; ++l) lines.push_back(l);
+    size_t last = end.Line();
+    for (size_t l = begin.Line(); l <= last; ++l) lines.push_back(l);
   }
   return lines;
 }
@@ -44,11 +49,111 @@ string Range::ToString() const {
 }
 
 bool Range::Valid() const {
-  return begin.fileName == end.fileName;
+  return begin.Valid() && begin.file == end.file;
 }
 
 bool Range::operator<(const Range& rhs) const {
-  return (begin.fileName < rhs.begin.fileName ||
-          begin.line < rhs.begin.line ||
-          begin.column < rhs.begin.column);
+  if (begin.file != rhs.begin.file) return begin.file < rhs.begin.file;
+  if (begin.offset != rhs.begin.offset) return begin.offset < rhs.begin.offset;
+  return end.offset < rhs.end.offset;
+}
+
+//
+
+vector<size_t> FindLineStarts(const char* begin, const char* end) {
+  vector<size_t> lineStarts{0};
+  for (const char* c = begin;
+      (c = (const char*)memchr(c, '\n', end - c)) != nullptr; ) {
+    lineStarts.push_back(++c - begin);
+  }
+  return lineStarts;
+}
+
+FileId SourceRegistry::Register(const string& fileName) {
+  lock_guard<mutex> lock(mutex_);
+  auto id = ids_.find(fileName);
+  if (id != ids_.end()) {
+    Source& source = sources_[id->second];
+    source.indexed = false;
+    source.lineStarts.clear();
+    return id->second;
+  }
+  FileId file = sources_.size();
+  sources_.push_back(Source{fileName, false, {}});
+  ids_[fileName] = file;
+  return file;
+}
+
+FileId SourceRegistry::Find(const string& fileName) const {
+  lock_guard<mutex> lock(mutex_);
+  auto id = ids_.find(fileName);
+  return (id == ids_.end()) ? kNoFile : id->second;
+}
+
+const string& SourceRegistry::FileName(FileId file) const {
+  static const string kNoName;
+  lock_guard<mutex> lock(mutex_);
+  return (file < sources_.size()) ? sources_[file].fileName : kNoName;
+}
+
+void SourceRegistry::IndexLines(FileId file, const char* begin,
+    const char* end) {
+  lock_guard<mutex> lock(mutex_);
+  if (file >= sources_.size() || sources_[file].indexed) return;
+  sources_[file].lineStarts = FindLineStarts(begin, end);
+  sources_[file].indexed = true;
+}
+
+SourceRegistry::Source& SourceRegistry::Indexed(FileId file) {
+  Source& source = sources_[file];
+  if (!source.indexed) {
+    MappedFile text(source.fileName);
+    if (text.good()) source.lineStarts = FindLineStarts(text.begin(), text.end());
+    source.indexed = true;
+  }
+  return source;
+}
+
+vector<size_t> SourceRegistry::LineStarts(FileId file) {
+  lock_guard<mutex> lock(mutex_);
+  if (file >= sources_.size()) return {};
+  return Indexed(file).lineStarts;
+}
+
+void SourceRegistry::SetLineStarts(FileId file, vector<size_t> lineStarts) {
+  lock_guard<mutex> lock(mutex_);
+  if (file >= sources_.size()) return;
+  sources_[file].lineStarts = move(lineStarts);
+  sources_[file].indexed = true;
+}
+
+size_t SourceRegistry::Line(FileId file, size_t offset) {
+  lock_guard<mutex> lock(mutex_);
+  if (file >= sources_.size()) return 0;
+  const vector<size_t>& lineStarts = Indexed(file).lineStarts;
+  return upper_bound(lineStarts.begin(), lineStarts.end(), offset) -
+      lineStarts.begin();
+}
+
+size_t SourceRegistry::Column(FileId file, size_t offset) {
+  lock_guard<mutex> lock(mutex_);
+  if (file >= sources_.size()) return 0;
+  const vector<size_t>& lineStarts = Indexed(file).lineStarts;
+  auto next = upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+  if (next == lineStarts.begin()) return 0;
+  return offset - *(next - 1) + 1;
+}
+
+size_t SourceRegistry::Offset(FileId file, size_t line, size_t column) {
+  lock_guard<mutex> lock(mutex_);
+  if (file >= sources_.size()) return 0;
+  const vector<size_t>& lineStarts = Indexed(file).lineStarts;
+  if (line == 0 || lineStarts.empty()) return 0;
+  line = min(line, lineStarts.size());
+  return lineStarts[line - 1] + (column ? column - 1 : 0);
+}
+
+SourceRegistry& Sources() {
+  static SourceRegistry registry;
+  return registry;
 }
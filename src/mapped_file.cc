@@ -0,0 +1,74 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+MappedFile::MappedFile(const string& fileName) : MappedFile() {
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+    size_ = info.st_size;
+    if (size_ == 0) {
+      good_ = true;
+    } else {
+      void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        //it is read front to back, once
+        madvise(data, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(data);
+        good_ = true;
+      } else {
+        size_ = 0;
+      }
+    }
+  }
+  //the mapping stays valid without the descriptor
+  close(fd);
+}
+
+MappedFile::MappedFile(MappedFile&& other) : MappedFile() {
+  *this = move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+  if (this != &other) {
+    Unmap();
+    swap(data_, other.data_);
+    swap(size_, other.size_);
+    swap(released_, other.released_);
+    swap(good_, other.good_);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() { Unmap(); }
+
+/*
+ * The mapping is private and never written to, so the pages are simply
+ * dropped (they would be read from the file again if they were touched).
+ */
+void MappedFile::Release(size_t offset) {
+  static const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  size_t end = min(offset, size_)/kPageSize*kPageSize;
+  if (end <= released_) return;
+  madvise(const_cast<char*>(data_) + released_, end - released_,
+      MADV_DONTNEED);
+  released_ = end;
+}
+
+void MappedFile::Unmap() {
+  if (data_) munmap(const_cast<char*>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+  released_ = 0;
+  good_ = false;
+}
@@ -0,0 +1,215 @@
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "editor_channel.h"
+
+using namespace vimserverNames;
+using namespace std;
+
+/*
+ * What the VimServer sees of vim: a cursor, the current file and the matches,
+ * and a handful of functions to get at them.  Anything else is an "ERROR", as
+ * vim answers an expression it can't evaluate.
+ */
+class MockEditor {
+ public:
+  explicit MockEditor(const string& fileName) : fileName_(fileName) {}
+
+  //a JSON value
+  string Evaluate(const string& expression) {
+    string name, arguments;
+    if (!expression.empty() && expression[0] == '[') {
+      return "[" + EvaluateList(expression.substr(1, expression.size() - 2)) +
+          "]";
+    }
+    if (!expression.empty() &&
+        expression.find_first_not_of("0123456789") == string::npos) {
+      return expression;
+    }
+    if (!SplitCall(expression, name, arguments)) return kError;
+    if (name == "line") return to_string(line_);
+    if (name == "col") return to_string(column_);
+    if (name == "getreg" || name == "expand" || name == "bufname") {
+      return JsonQuote(fileName_);
+    }
+    if (name == "mode") return JsonQuote(mode_);
+    if (name == "cursor") {
+      vector<string> values = SplitList(arguments);
+      if (values.size() != 2) return kError;
+      line_ = strtoul(values[0].c_str(), nullptr, 10);
+      column_ = strtoul(values[1].c_str(), nullptr, 10);
+      return "0";
+    }
+    if (name == "matchadd" || name == "matchaddpos") {
+      matches_[nextMatch_] = arguments;
+      return to_string(nextMatch_++);
+    }
+    if (name == "matchdelete") {
+      return matches_.erase(strtoul(arguments.c_str(), nullptr, 10)) ?
+          "0" : "-1";
+    }
+    if (name == "setloclist") return "0";
+    if (name == "execute") {
+      Execute(Unquote(arguments));
+      return "\"\"";
+    }
+    return kError;
+  }
+
+  //commands are separated by " | ", false to quit
+  bool Execute(const string& commands) {
+    for (string command : Split(commands, " | ")) {
+      while (!command.empty() && command[0] == ':') command.erase(0, 1);
+      string word = command.substr(0, command.find(' '));
+      string rest = (word.size() < command.size()) ?
+          command.substr(word.size() + 1) : "";
+      if (word == "edit" || word == "e") {
+        fileName_ = rest;
+        line_ = column_ = 1;
+      } else if (word == "call") {
+        Evaluate(rest);
+      } else if (word == "xa" || word == "qa" || word == "q") {
+        running_ = false;
+      } else if (word == "stopinsert") {
+        mode_ = "n";
+      }
+    }
+    return running_;
+  }
+
+  bool Running() const { return running_; }
+
+ private:
+  const string kError = "\"ERROR\"";
+
+  //a vim string in single quotes
+  static string Unquote(const string& quoted) {
+    if (quoted.size() < 2 || quoted[0] != '\'') return quoted;
+    string s;
+    for (size_t i = 1; i + 1 < quoted.size(); ++i) {
+      s += quoted[i];
+      if (quoted[i] == '\'' && quoted[i + 1] == '\'') ++i;
+    }
+    return s;
+  }
+
+  static vector<string> Split(const string& s, const string& separator) {
+    vector<string> parts;
+    size_t begin = 0;
+    for (size_t end; (end = s.find(separator, begin)) != string::npos;
+        begin = end + separator.size()) {
+      parts.push_back(s.substr(begin, end - begin));
+    }
+    parts.push_back(s.substr(begin));
+    return parts;
+  }
+
+  //name(arguments)
+  static bool SplitCall(const string& expression, string& name,
+      string& arguments) {
+    size_t open = expression.find('(');
+    if (open == string::npos || expression.back() != ')') return false;
+    name = expression.substr(0, open);
+    arguments = expression.substr(open + 1, expression.size() - open - 2);
+    return true;
+  }
+
+  //split at the commas that aren't in a string or brackets
+  static vector<string> SplitList(const string& list) {
+    vector<string> items(1);
+    int depth = 0;
+    char quote = '\0';
+    for (char c : list) {
+      if (quote) {
+        if (c == quote) quote = '\0';
+      } else if (c == '\'' || c == '"') {
+        quote = c;
+      } else if (c == '(' || c == '[') {
+        ++depth;
+      } else if (c == ')' || c == ']') {
+        --depth;
+      } else if (c == ',' && depth == 0) {
+        items.emplace_back();
+        continue;
+      }
+      if (!items.back().empty() || c != ' ') items.back() += c;
+    }
+    return items;
+  }
+
+  string EvaluateList(const string& list) {
+    string values;
+    for (const string& item : SplitList(list)) {
+      values += (values.empty() ? "" : ",") + Evaluate(item);
+    }
+    return values;
+  }
+
+  string fileName_;
+  size_t line_ = 1;
+  size_t column_ = 1;
+  string mode_ = "n";
+  map<size_t, string> matches_;
+  size_t nextMatch_ = 1;
+  bool running_ = true;
+};
+
+/*
+ * Stands in for vim at the other end of the VimServer's channel, so that it
+ * can be tried (and timed) without an editor.  It connects to the socket named
+ * by $HARMONOGRAM_CHANNEL, as vim would be told to, and answers the channel's
+ * "expr" and "ex" messages (with execute() for the commands in an
+ * EditorBatch) until it is told to quit or the socket closes.
+ * With --verbose every message is printed as it comes in.
+ *
+ * usage: mockeditor [--verbose] [file...]
+ *
+ * example:
+ * VimServer server("test", "elf/mockeditor");
+ * server.Activate();
+ */
+int main(int argc, char** argv) {
+  bool verbose = false;
+  vector<string> fileNames;
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (arg == "--verbose") verbose = true;
+    else fileNames.push_back(arg);
+  }
+  const char* path = getenv(kChannelVariable);
+  if (!path) {
+    cerr << "mockeditor: $" << kChannelVariable << " isn't set" << endl;
+    return 2;
+  }
+  JsonSocket socket = ConnectChannel(path);
+  if (!socket.good()) {
+    cerr << "mockeditor: couldn't connect to: " << path << endl;
+    return 1;
+  }
+
+  MockEditor editor(fileNames.empty() ? "" : fileNames[0]);
+  JsonValue message;
+  while (editor.Running() && socket.good()) {
+    if (!socket.Receive(message, 1)) continue;
+    if (message.kind != JsonValue::kArray || message.items.empty()) continue;
+    const string& kind = message.items[0].text;
+    if (verbose) {
+      cerr << "mockeditor: " << kind;
+      if (message.items.size() > 1) cerr << " " << message.items[1].text;
+      cerr << endl;
+    }
+    if (kind == "expr" && message.items.size() == 3) {
+      socket.Send("[" + message.items[2].text + "," +
+          editor.Evaluate(message.items[1].text) + "]");
+    } else if (kind == "expr" && message.items.size() == 2) {
+      //no id, no answer
+      editor.Evaluate(message.items[1].text);
+    } else if (kind == "ex" && message.items.size() == 2) {
+      editor.Execute(message.items[1].text);
+    }
+  }
+  return 0;
+}
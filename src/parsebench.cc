@@ -0,0 +1,567 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lexer.h"
+#include "decimal.h"
+#include "location.h"
+#include "mapped_file.h"
+#include "pendulum.h"
+#include "pendulum_parser.h"
+#include "scene.h"
+#include "scene_file.h"
+#include "trie.h"
+
+using namespace pendulumNames;
+using namespace std;
+
+double PendulumBase::timeDelta = .01;
+
+/*
+ * Parse throughput benchmark.  Generates a scene with a lot of pendulums,
+ * then parses it with the HarmonogramParser and with the LegacyParser, and
+ * reports MB/s for both, and for the Lexer's Next() alone.  The LegacyParser
+ * is the original Trie and istream based parser, kept here only to have
+ * something to compare against.
+ *
+ * This is done for a scene written like a person would (4 decimals), and for
+ * a numerics heavy one with 15 significant digits in every number.  Then the
+ * number parsing on its own: istream >> double, strtod and ParseDecimal, on
+ * numbers written a few different ways.
+ *
+ * Each scene is also compiled to a scene file (as harmc would), and loaded
+ * both ways through the HarmonogramParser, warm (the files in the page cache)
+ * and cold (dropped from it before every run, which needs the files to be on
+ * a real disk, not a tmpfs).
+ *
+ * usage: parsebench [pendulums] [file]
+ *
+ * The parsers talk a lot on cout, which is sent nowhere while timing, so that
+ * only the parsing is measured.  Returns 1 if the two parsers disagree, if the
+ * scene file doesn't load the same scene, if a scene file with a cycle of
+ * compounds is loaded, or if ParseDecimal doesn't give exactly what strtod
+ * does.
+ */
+
+class LegacyParser {
+  //what a Location used to be
+  struct LegacyLocation {
+    string fileName;
+    size_t line;
+    size_t column;
+  };
+
+ public:
+  LegacyParser() {
+    for (const auto& p : GetTokenList()) trie_.Insert(p.second);
+  }
+
+  void Parse(const string& fileName, vector<SimplePendulum>& pendulums,
+      CompoundPendulum& compound) {
+    location_ = LegacyLocation{fileName, 1, 1};
+    ifstream file(fileName);
+    input_ = &file;
+    trie_.Reset();
+    ReadCurrentInput(pendulums, compound);
+  }
+
+ private:
+  TokenName Token() {
+    string token = trie_.GetToken();
+    for (const auto& p : GetTokenList()) {
+      if (token == p.second) return p.first;
+    }
+    return kTokInvalid;
+  }
+
+  bool Advance() {
+    lastRead_ = trie_.ReadNext(*input_);
+    if (lastRead_.find('\n') != lastRead_.npos) location_.column = 0;
+    location_.line += count(lastRead_.begin(), lastRead_.end(), '\n');
+    location_.column += lastRead_.size() - lastRead_.find_last_of('\n');
+    return input_->good();
+  }
+
+  bool Good() { return input_->good(); }
+
+  void ReadCommaDouble(double& d) {
+    Advance();
+    if (Token() == kTokComma) *input_ >> d;
+  }
+
+  Color ReadColor() {
+    Color color;
+    *input_ >> color.R;
+    ReadCommaDouble(color.G);
+    ReadCommaDouble(color.B);
+    ReadCommaDouble(color.A);
+    return color;
+  }
+
+  Position ReadPosition() {
+    Position position;
+    *input_ >> position.x;
+    ReadCommaDouble(position.y);
+    return position;
+  }
+
+  string ReadIdentifier() {
+    string id;
+    *input_ >> std::ws;
+    while (Good() && isalnum(input_->peek())) id.push_back(input_->get());
+    return id;
+  }
+
+  void ReadComment() {
+    while (Good()) {
+      Advance();
+      if (Token() == kTokCommentEnd) return;
+    }
+  }
+
+  SimplePendulum ReadPendulum() {
+    SimplePendulum pendulum;
+    double startPhase;
+    bool read = false;
+    while (Good() && !read && Token() != kTokPendulumEnd) {
+      Advance();
+      switch (Token()) {
+        case kTokType : {
+          string typeName = ReadIdentifier();
+          for (auto& c : typeName) c = tolower(c);
+          pendulum.type = (typeName == "rotation") ?
+            SimplePendulum::kRotation : SimplePendulum::kOscillation;
+        } break;
+        case kTokName : pendulum.name = ReadIdentifier(); break;
+        case kTokCenter : pendulum.center = ReadPosition(); break;
+        case kTokFrequency : *input_ >> pendulum.frequency.value; break;
+        case kTokColor : pendulum.color = ReadColor(); break;
+        case kTokStartPhase : *input_ >> startPhase;
+                              pendulum.frequency.SetStartPhase(startPhase);
+                              break;
+        case kTokDirection : pendulum.direction = ReadPosition(); break;
+        case kTokAmplitude : *input_ >> pendulum.amplitude; break;
+        case kTokCommentBegin : ReadComment(); break;
+        default : read = true;
+      }
+    }
+    pendulum.SetPreferredBufferSize(PendulumBase::timeDelta);
+    return pendulum;
+  }
+
+  void ReadCurrentInput(vector<SimplePendulum>& pendulums,
+      CompoundPendulum& compound) {
+    LegacyLocation startLocation = location_;
+    bool read = false;
+    while (Good() && !read) {
+      Advance();
+      LegacyLocation location = location_;
+      switch (Token()) {
+        case kTokPendulumBegin :
+          pendulums.push_back(ReadPendulum());
+          locationMap_[pendulums.back().name] = make_pair(location, location_);
+          break;
+        case kTokCenter : compound.center = ReadPosition(); break;
+        case kTokColor : compound.color = ReadColor(); break;
+        case kTokCommentBegin : ReadComment(); break;
+        case kTokCycles: *input_ >> compound.cycles_; break;
+        case kTokName : compound.name = ReadIdentifier(); break;
+        default : read = true;
+      }
+    }
+    locationMap_[compound.name] = make_pair(startLocation, location_);
+  }
+
+  istream* input_;
+  Trie trie_;
+  LegacyLocation location_;
+  string lastRead_;
+  map<PendulumId, pair<LegacyLocation, LegacyLocation>> locationMap_;
+};
+
+//writes "count" random pendulums
+void WriteScene(ostream& out, size_t count, ios::fmtflags format,
+    int precision, unsigned seed = 1) {
+  mt19937 random(seed);
+  uniform_real_distribution<double> unit(0, 1);
+  out.flags(format);
+  out << setprecision(precision);
+  out << "name: bench\ncenter: 400,300\ncolor: .2,.8,.7,1\ncycles: 2.5\n\n";
+  out << "/*\n   generated by parsebench\n*/\n";
+  for (size_t i = 0; i < count; ++i) {
+    out << "{\n"
+        << "  type: " << (i % 2 ? "rotation" : "oscillation") << '\n'
+        << "  name: p" << i << '\n'
+        << "  center: " << 800*unit(random) << ',' << 600*unit(random) << '\n'
+        << "  frequency: " << .1 + 2*unit(random) << '\n'
+        << "  color: " << unit(random) << ',' << unit(random) << ','
+                       << unit(random) << ",.8\n"
+        << "  startphase: " << unit(random) << '\n'
+        << "  direction: " << unit(random) << ',' << unit(random) << '\n'
+        << "  amplitude: " << 10 + 90*unit(random) << '\n'
+        << "}\n";
+  }
+}
+
+//returns the size of the file
+size_t GenerateScene(const string& fileName, size_t count,
+    ios::fmtflags format, int precision) {
+  ofstream out(fileName);
+  WriteScene(out, count, format, precision);
+  return out.tellp();
+}
+
+class NullBuffer : public streambuf {
+ protected:
+  int overflow(int c) override { return c; }
+};
+
+//best of "repetitions", in seconds, calling "before" (untimed) before each
+double TimeIt(const function<void()>& f, size_t repetitions,
+    const function<void()>& before = nullptr) {
+  double best = 1e30;
+  for (size_t i = 0; i < repetitions; ++i) {
+    if (before) before();
+    auto begin = chrono::steady_clock::now();
+    f();
+    auto end = chrono::steady_clock::now();
+    best = min(best, chrono::duration<double>(end - begin).count());
+  }
+  return best;
+}
+
+//a summary of everything that was read, to compare the parsers
+double Checksum(const SimplePendulum& p) {
+  return p.center.x + p.center.y + p.frequency.value + p.frequency.phase +
+      p.color.R + p.color.G + p.color.B + p.color.A + p.direction.x +
+      p.direction.y + p.amplitude + p.type + p.name.size();
+}
+
+bool SceneBench(const string& fileName, size_t count, ios::fmtflags format,
+    int precision) {
+  const size_t repetitions = 3;
+  double megabytes = GenerateScene(fileName, count, format, precision)/1e6;
+  cout << "scene: " << fileName << ", " << count << " pendulums, "
+       << precision << " digits, " << fixed << setprecision(1) << megabytes
+       << " MB" << endl;
+
+  NullBuffer null;
+  streambuf* coutBuffer = cout.rdbuf(&null);
+
+  vector<SimplePendulum> legacyPendulums;
+  CompoundPendulum legacyCompound;
+  double legacySeconds = TimeIt([&]() {
+      legacyPendulums.clear();
+      LegacyParser legacy;
+      legacy.Parse(fileName, legacyPendulums, legacyCompound);
+    }, repetitions);
+
+  Scene scene;
+  HarmonogramParser parser;
+  double seconds = TimeIt([&]() { parser.Parse({fileName}, scene); },
+      repetitions);
+
+  cout.rdbuf(coutBuffer);
+
+  MappedFile file(fileName);
+  size_t tokens = 0;
+  double lexSeconds = TimeIt([&]() {
+      Lexer lexer(file.begin(), file.end());
+      for (tokens = 0; lexer.Next() != kTokInvalid; ++tokens) {}
+    }, repetitions);
+
+  double legacySum = 0, sum = 0;
+  size_t simples = 0;
+  for (const auto& p : legacyPendulums) legacySum += Checksum(p);
+  for (PendulumHandle handle : scene.Handles()) {
+    if (handle.kind != PendulumHandle::kSimple) continue;
+    sum += Checksum(static_cast<const SimplePendulum&>(scene[handle]));
+    ++simples;
+  }
+  bool same = simples == legacyPendulums.size() && sum == legacySum;
+
+  cout << setw(8) << "legacy" << setw(10) << setprecision(1)
+       << megabytes/legacySeconds << " MB/s" << setw(10) << setprecision(3)
+       << legacySeconds << " s" << endl;
+  cout << setw(8) << "mmap" << setw(10) << setprecision(1)
+       << megabytes/seconds << " MB/s" << setw(10) << setprecision(3)
+       << seconds << " s" << setw(8) << setprecision(1)
+       << legacySeconds/seconds << "x" << endl;
+  cout << setw(8) << "tokens" << setw(10) << setprecision(1)
+       << megabytes/lexSeconds << " MB/s" << setw(10) << setprecision(3)
+       << lexSeconds << " s" << setw(8) << tokens << " tokens" << endl;
+  cout << "pendulums: " << legacyPendulums.size() << " / " << simples
+       << (same ? ", same" : ", DIFFERENT") << endl << endl;
+  return same;
+}
+
+//drops the file from the page cache, so that the next read is from the disk
+void Evict(const string& fileName) {
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) return;
+  //dirty pages can't be dropped
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+/*
+ * Startup: the scene in fileName, read by the HarmonogramParser as text and
+ * as a scene file compiled from it, with and without the page cache.
+ */
+bool CompiledBench(const string& fileName) {
+  const size_t repetitions = 3;
+  const string compiledName = fileName + "c";
+  NullBuffer null;
+  streambuf* coutBuffer = cout.rdbuf(&null);
+
+  Scene textScene, scene;
+  HarmonogramParser textParser, parser;
+  textParser.Parse({fileName}, textScene);
+  bool written = WriteSceneFile(compiledName, textScene,
+      textParser.blockHashes, &textParser.locationMap);
+  auto evict = [&]() {
+    Evict(fileName);
+    Evict(compiledName);
+  };
+  auto parseText = [&]() { textParser.Parse({fileName}, textScene); };
+  auto load = [&]() { parser.Parse({compiledName}, scene); };
+  double textWarm = TimeIt(parseText, repetitions);
+  double textCold = TimeIt(parseText, repetitions, evict);
+  double warm = TimeIt(load, repetitions);
+  double cold = TimeIt(load, repetitions, evict);
+
+  cout.rdbuf(coutBuffer);
+
+  double textSum = 0, sum = 0;
+  for (PendulumHandle handle : textScene.Handles()) {
+    if (handle.kind != PendulumHandle::kSimple) continue;
+    textSum += Checksum(static_cast<const SimplePendulum&>(textScene[handle]));
+  }
+  for (PendulumHandle handle : scene.Handles()) {
+    if (handle.kind != PendulumHandle::kSimple) continue;
+    sum += Checksum(static_cast<const SimplePendulum&>(scene[handle]));
+  }
+  bool same = written && scene.size() == textScene.size() && sum == textSum &&
+      parser.blockHashes == textParser.blockHashes &&
+      parser.locationMap.size() == textParser.locationMap.size();
+
+  MappedFile text(fileName), compiled(compiledName);
+  cout << "startup: text " << setprecision(1) << text.size()/1e6
+       << " MB, scene file " << compiled.size()/1e6 << " MB" << endl;
+  auto report = [&](const char* format, double coldSeconds,
+      double warmSeconds) {
+    cout << setw(8) << format << setw(10) << setprecision(3) << coldSeconds
+         << " s cold" << setw(10) << warmSeconds << " s warm";
+  };
+  report("text", textCold, textWarm);
+  cout << endl;
+  report("compiled", cold, warm);
+  cout << setw(8) << setprecision(1) << textCold/cold << "x" << setw(8)
+       << textWarm/warm << "x" << endl;
+  cout << "pendulums: " << textScene.size() << " / " << scene.size()
+       << (same ? ", same" : ", DIFFERENT") << endl << endl;
+  return same;
+}
+
+/*
+ * Not a benchmark: scene files with compounds nested in each other have to
+ * load, and those with compounds made of themselves (directly, or through
+ * another) have to be turned down as a whole.
+ */
+bool CyclicSceneFileCheck(const string& directory) {
+  SimplePendulum simple;
+  simple.type = SimplePendulum::kRotation;
+  simple.frequency.value = 1;
+  simple.name = "s";
+  CompoundPendulum a, b;
+  a.name = "a";
+  b.name = "b";
+  //edges are (compound, child), loads is whether the file should
+  auto check = [&](const string& name,
+      vector<pair<size_t, size_t>> edges, bool loads) {
+    Scene scene;
+    scene.Add(simple);
+    vector<PendulumHandle> compounds{scene.Add(a), scene.Add(b)};
+    for (const auto& edge : edges) {
+      scene.AddChild(compounds[edge.first], compounds[edge.second]);
+    }
+    string fileName = directory + "/parsebench." + name + ".harmc";
+    WriteSceneFile(fileName, scene, {}, nullptr);
+    MappedFile file(fileName);
+    Scene loaded;
+    map<string, uint64_t> hashes;
+    NullBuffer null;
+    streambuf* coutBuffer = cout.rdbuf(&null);
+    bool read = ReadSceneFile(file.begin(), file.end(), loaded,
+        PendulumBase::timeDelta, hashes, nullptr);
+    cout.rdbuf(coutBuffer);
+    remove(fileName.c_str());
+    bool ok = read == loads && loaded.size() == (loads ? scene.size() : 0);
+    cout << setw(14) << name << (loads ? "  loads" : "  turned down")
+         << (ok ? ", ok" : ", FAILED") << endl;
+    return ok;
+  };
+  cout << "scene file cycles:" << endl;
+  bool ok = check("nested", {{0, 1}}, true);
+  ok = check("self", {{0, 0}}, false) && ok;
+  ok = check("cycle", {{0, 1}, {1, 0}}, false) && ok;
+  cout << endl;
+  return ok;
+}
+
+/*
+ * What a scene generator (or a test) does: makes lots of small scenes and
+ * parses them, either through temporary files or as NamedBuffers.  Both
+ * include making the text.
+ */
+bool BufferBench(const string& directory, size_t scenes, size_t count) {
+  const size_t repetitions = 3;
+  cout << "generated: " << scenes << " scenes of " << count << " pendulums"
+       << endl;
+  NullBuffer null;
+  streambuf* coutBuffer = cout.rdbuf(&null);
+
+  HarmonogramParser parser;
+  Scene fileScene, scene;
+  list<string> fileNames;
+  double fileSeconds = TimeIt([&]() {
+      fileNames.clear();
+      for (size_t i = 0; i < scenes; ++i) {
+        fileNames.push_back(directory + "/parsebench" + to_string(i) + ".harm");
+        ofstream out(fileNames.back());
+        WriteScene(out, count, ios::fixed, 4, i);
+      }
+      parser.Parse(fileNames, fileScene);
+    }, repetitions);
+  for (const string& fileName : fileNames) remove(fileName.c_str());
+
+  double bufferSeconds = TimeIt([&]() {
+      vector<NamedBuffer> buffers;
+      for (size_t i = 0; i < scenes; ++i) {
+        ostringstream out;
+        WriteScene(out, count, ios::fixed, 4, i);
+        buffers.push_back(NamedBuffer{"generated/" + to_string(i), out.str()});
+      }
+      parser.Parse(buffers, scene);
+    }, repetitions);
+
+  cout.rdbuf(coutBuffer);
+
+  double fileSum = 0, sum = 0;
+  for (PendulumHandle handle : fileScene.Handles()) {
+    if (handle.kind != PendulumHandle::kSimple) continue;
+    fileSum += Checksum(static_cast<const SimplePendulum&>(fileScene[handle]));
+  }
+  for (PendulumHandle handle : scene.Handles()) {
+    if (handle.kind != PendulumHandle::kSimple) continue;
+    sum += Checksum(static_cast<const SimplePendulum&>(scene[handle]));
+  }
+  bool same = scene.size() == fileScene.size() && sum == fileSum &&
+      parser.diagnostics.empty();
+
+  cout << setw(8) << "files" << setw(10) << setprecision(3) << fileSeconds
+       << " s" << endl;
+  cout << setw(8) << "buffers" << setw(10) << bufferSeconds << " s"
+       << setw(8) << setprecision(1) << fileSeconds/bufferSeconds << "x"
+       << endl;
+  cout << "pendulums: " << fileScene.size() << " / " << scene.size()
+       << (same ? ", same" : ", DIFFERENT") << endl << endl;
+  return same;
+}
+
+/*
+ * "count" random numbers of all sizes, separated by ','s, read back with
+ * each of the parsers.  ParseDecimal has to agree with strtod to the bit.
+ */
+bool NumberBench(const string& name, size_t count, ios::fmtflags format,
+    int precision) {
+  const size_t repetitions = 3;
+  mt19937 random(2);
+  uniform_real_distribution<double> mantissa(-10, 10);
+  uniform_int_distribution<int> exponent(-8, 8);
+  ostringstream out;
+  out.flags(format);
+  out << setprecision(precision);
+  for (size_t i = 0; i < count; ++i) {
+    out << mantissa(random)*pow(10, exponent(random)) << ',';
+  }
+  const string text = out.str();
+  const char* end = text.data() + text.size();
+  vector<double> expected(count), read(count);
+
+  double istreamSeconds = TimeIt([&]() {
+      istringstream in(text);
+      char comma;
+      for (size_t i = 0; i < count; ++i) in >> read[i] >> comma;
+    }, repetitions);
+  double strtodSeconds = TimeIt([&]() {
+      char* p = const_cast<char*>(text.c_str());
+      for (size_t i = 0; i < count; ++i) {
+        expected[i] = strtod(p, &p);
+        ++p;
+      }
+    }, repetitions);
+  double seconds = TimeIt([&]() {
+      const char* p = text.data();
+      for (size_t i = 0; i < count; ++i) {
+        p = ParseDecimal(p, end, read[i]).end + 1;
+      }
+    }, repetitions);
+
+  size_t wrong = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (memcmp(&read[i], &expected[i], sizeof(double)) != 0) ++wrong;
+  }
+  cout << "numbers: " << name << ", e.g. " << text.substr(0, text.find(','))
+       << endl;
+  double megabytes = text.size()/1e6;
+  auto report = [&](const char* parser, double s) {
+    cout << setw(14) << parser << setw(10) << setprecision(1)
+         << megabytes/s << " MB/s" << setw(10) << setprecision(1)
+         << 1e9*s/count << " ns/number" << endl;
+  };
+  report("istream", istreamSeconds);
+  report("strtod", strtodSeconds);
+  report("ParseDecimal", seconds);
+  cout << "  " << (wrong ? "FAILED" : "ok") << " (" << wrong
+       << " differ from strtod)" << endl << endl;
+  return wrong == 0;
+}
+
+int main(int argc, char** argv) {
+  size_t count = (argc > 1) ? stoul(argv[1]) : 200000;
+  string fileName = (argc > 2) ? argv[2] : "/tmp/parsebench.harm";
+
+  bool ok = SceneBench(fileName, count, ios::fixed, 4);
+  ok = CompiledBench(fileName) && ok;
+  ok = SceneBench(fileName, count, ios::fmtflags(), 15) && ok;
+  ok = CompiledBench(fileName) && ok;
+  ok = BufferBench("/tmp", 2000, 10) && ok;
+  ok = CyclicSceneFileCheck("/tmp") && ok;
+
+  const size_t numbers = 2000000;
+  ok = NumberBench("fixed, 4 decimals", numbers, ios::fixed, 4) && ok;
+  ok = NumberBench("15 digits", numbers, ios::fmtflags(), 15) && ok;
+  ok = NumberBench("scientific, 6 digits", numbers, ios::scientific, 6) && ok;
+  //past what the fast path can do, so mostly strtod
+  ok = NumberBench("17 digits", numbers, ios::fmtflags(), 17) && ok;
+  return ok ? 0 : 1;
+}
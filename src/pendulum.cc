@@ -172,7 +172,7 @@ void SimplePendulum::UpdatePosition() {
   }
 }
 
-void SimplePendulum::SetPreferredBufferSize() {
+void SimplePendulum::SetPreferredBufferSize(double timeDelta) {
   switch(type) {
   case SimplePendulum::kRotation : // draws 3/4 complete cycle
     preferredBufferSize = (size_t)round(.75*GetPeriod()/timeDelta); break;
@@ -180,7 +180,6 @@ void SimplePendulum::SetPreferredBufferSize() {
      preferredBufferSize = (size_t)round(.125*GetPeriod()/timeDelta); break;
   default: assert(false);
   }
-  cout << "Simple Buffer size: " << preferredBufferSize << endl;
 }
 
 void CompoundPendulum::SetPreferredBufferSize() {
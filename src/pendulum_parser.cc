@@ -4,287 +4,569 @@
 #include <cassert>
 #include <cctype>
 #include <climits>
-#include <fstream>
-#include <iomanip>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <list>
 #include <string>
 #include <utility>
+#include <vector>
+
+#include "mapped_file.h"
+#include "scene_file.h"
 
 using namespace pendulumNames;
+using std::future;
 
-//Token stuff
-enum TokenName {
-  kTokAmplitude,
-  kTokCenter,
-  kTokColor,
-  kTokComma,
-  kTokCommentBegin,
-  kTokCommentEnd,
-  kTokCycles,
-  kTokDirection,
-  kTokFrequency,
-  kTokInvalid,
-  kTokName,
-  kTokOscillation,
-  kTokPendulumBegin,
-  kTokPendulumEnd,
-  kTokRotation,
-  kTokStartPhase,
-  kTokType
-};
+//
+//Parsing Utilities, forward declared Just in Case...
 
-const list<pair<TokenName, string>> tokenList {
- {kTokAmplitude, "amplitude:"},
- {kTokCenter, "center:"},
- {kTokColor, "color:"},
- {kTokComma, ","},
- {kTokCommentBegin, "/*"},
- {kTokCommentEnd, "*/"},
- {kTokCycles, "cycles:"},
- {kTokDirection, "direction:"},
- {kTokFrequency, "frequency:"},
- {kTokName, "name:"},
- {kTokOscillation, "oscillation"},
- {kTokPendulumBegin, "{"},
- {kTokPendulumEnd, "}"},
- {kTokRotation, "rotation"},
- {kTokStartPhase, "startphase:"},
- {kTokType, "type:"}
-};
+Color ReadColor(FileParser& parser);
+void ReadCommaDouble(FileParser& parser, double& d);
+void ReadComment(FileParser& parser);
+void ReadCurrentInput(FileParser& parser, PendulumSink& sink);
+void ReadDouble(FileParser& parser, double& d);
+string ReadIdentifier(FileParser& parser);
+SimplePendulum ReadPendulum(FileParser& parser);
+Position ReadPosition(FileParser& parser);
+SimplePendulum::Type ReadType(FileParser& parser);
+//
+
+string Diagnostic::ToString() const {
+  if (line == 0) return location.ToString() + ": " + message;
+  return location.FileName() + ":" + std::to_string(line) + ":" +
+      std::to_string(column) + ": " + message;
+}
+
+vector<Diagnostic> pendulumNames::CycleDiagnostics(const Scene& scene,
+    const map<PendulumId, Range>& locationMap) {
+  vector<Diagnostic> diagnostics;
+  for (PendulumHandle handle : scene.Cyclic()) {
+    const string& name = scene[handle].name;
+    auto range = locationMap.find(name);
+    diagnostics.push_back(Diagnostic{
+        (range == locationMap.end()) ? Location() : range->second.begin,
+        "compound " + name + " is part of (or made of) a cycle"});
+  }
+  return diagnostics;
+}
 
-list<pair<TokenName, string>> GetTokenList() {
-  return {
- {kTokAmplitude, "amplitude:"},
- {kTokCenter, "center:"},
- {kTokColor, "color:"},
- {kTokComma, ","},
- {kTokCommentBegin, "/*"},
- {kTokCommentEnd, "*/"},
- {kTokCycles, "cycles:"},
- {kTokDirection, "direction:"},
- {kTokFrequency, "frequency:"},
- {kTokName, "name:"},
- {kTokOscillation, "oscillation"},
- {kTokPendulumBegin, "{"},
- {kTokPendulumEnd, "}"},
- {kTokRotation, "rotation"},
- {kTokStartPhase, "startphase:"},
- {kTokType, "type:"}
+//From the FileParser class
+
+//what Parse(Scene&) hands the pendulums to
+class SceneSink : public PendulumSink {
+ public:
+  SceneSink(FileParser& parser, Scene& scene)
+    : parser_(parser), scene_(scene) {}
+
+  void OnPendulum(SimplePendulum pendulum, const Range& range,
+      uint64_t blockHash) override {
+    parser_.blockHashes[pendulum.name] = blockHash;
+    if (parser_.locationMap.count(pendulum.name)) {
+      parser_.log << "warning, overwriting node: " << pendulum.name << endl;
+    }
+    parser_.log << pendulum.name << " -> " << range.ToString() << endl;
+    //SetPreferredBufferSize() is called on the pool, so it can't print
+    parser_.log << "Simple Buffer size: " << pendulum.preferredBufferSize
+                << endl;
+    parser_.locationMap[pendulum.name] = range;
+    children_.push_back(scene_.Add(move(pendulum)));
+  }
+
+  void OnCompound(CompoundPendulum compound, size_t children,
+      const Range& range, uint64_t blockHash) override {
+    parser_.locationMap[compound.name] = range;
+    parser_.blockHashes[compound.name] = blockHash;
+    //the buffer size is set by Scene::Link, once the children are known
+    PendulumHandle handle = scene_.Add(move(compound));
+    for (size_t i = children_.size() - children; i < children_.size(); ++i) {
+      scene_.AddChild(handle, children_[i]);
+    }
+    children_.clear();
+  }
+
+ private:
+  FileParser& parser_;
+  Scene& scene_;
+  vector<PendulumHandle> children_;
 };
+
+FileParser::FileParser(const string& fileName, double timeDelta)
+  : fileName_(fileName), timeDelta_(timeDelta) {}
+
+FileParser::FileParser(const string& name, StringSlice text,
+    double timeDelta)
+  : text_(text), fileName_(name), timeDelta_(timeDelta), inMemory_(true) {}
+
+bool FileParser::Advance() {
+  if (failed_) return false;
+  lexer_.Next();
+  return Good();
 }
 
-TokenName StringToTokenName(const string& str) {
-  for (const auto& p : tokenList) {
-    if (str == p.second) return p.first;
+/*
+ * The line and column come from the running count rather than the Sources(),
+ * which would index the whole text: a PendulumSink parse has given most of it
+ * back by now.
+ */
+void FileParser::Error(const string& message) {
+  if (failed_) return;
+  failed_ = true;
+  Location location = GetLocation();
+  CountLines(location.offset);
+  diagnostics.push_back(Diagnostic{location, message, lineCount_ + 1,
+      location.offset - lineStart_ + 1});
+}
+
+void FileParser::CountLines(size_t offset) {
+  offset = std::min(offset, text_.size);
+  if (offset <= countedTo_) return;
+  const char* begin = text_.begin();
+  for (const char* c = begin + countedTo_;
+      (c = (const char*)memchr(c, '\n', offset - (c - begin))) != nullptr; ) {
+    lineStart_ = ++c - begin;
+    ++lineCount_;
   }
-  return kTokInvalid;
+  countedTo_ = offset;
 }
 
-//
-//Parsing Utilities, forward declared Just in Case...
+string FileParser::GetCursor() {
+  return GetLocation().ToString();
+}
 
-Color ReadColor(HarmonogramParser& parser);
-void ReadCommaDouble(HarmonogramParser& parser, double& d);
-void ReadComment(HarmonogramParser& parser);
-list<PendulumPtr> ReadCurrentInput(HarmonogramParser& parser);
-string ReadIdentifier(HarmonogramParser& parser);
-PendulumPtr ReadPendulum(HarmonogramParser& parser);
-Position ReadPosition(HarmonogramParser& parser);
-SimplePendulum::Type ReadType(HarmonogramParser& parser);
-//
+Location FileParser::GetLocation() {
+  return Location{fileId_, lexer_.Offset()};
+}
 
-//From the HarmonogramParser class
+/*
+ * The comments are skipped whole, so that a '{' in one isn't taken for a
+ * pendulum.  The token that was read when the error was found may be the '{'
+ * itself (e.g. when a '}' is missing), so that one counts too.
+ */
+bool FileParser::Recover() {
+  if (!failed_) return false;
+  failed_ = false;
+  while (!lexer_.AtEnd() && lexer_.Token() != kTokPendulumBegin) {
+    if (lexer_.Next() == kTokCommentBegin) {
+      while (!lexer_.AtEnd() && lexer_.Next() != kTokCommentEnd) {}
+    }
+  }
+  return true;
+}
 
-HarmonogramParser::HarmonogramParser() {
-  location_.Reset();
-  for (const auto& p : GetTokenList()) {
-    trie_.Insert(p.second);
+/*
+ * There is no file to find the lines of a buffer in later, so they are found
+ * now.  The buffer's name may well be that of a file on disk too, which would
+ * be the wrong one.
+ */
+bool FileParser::Open() {
+  fileId_ = Sources().Register(fileName_);
+  released_ = 0;
+  if (inMemory_) {
+    Sources().IndexLines(fileId_, text_.begin(), text_.end());
+    return true;
   }
+  file_ = MappedFile(fileName_);
+  if (!file_.good()) return false;
+  text_ = StringSlice{file_.begin(), file_.size()};
+  return true;
 }
 
-bool HarmonogramParser::Advance() {
-  lastRead = move(trie_.ReadNext(GetStream()));
-  AdvanceCursor();
-  return input_->good();
+void FileParser::Close() {
+  //the lexer points into the text
+  lexer_ = Lexer();
+  if (!inMemory_) {
+    text_ = StringSlice{nullptr, 0};
+    file_ = MappedFile();
+  }
 }
 
-void HarmonogramParser::AdvanceCursor() {
-  if (lastRead.find('\n') != lastRead.npos) location_.column = 0;
-  location_.line += count_if(lastRead.begin(), lastRead.end(),
-      [](char c) -> bool { return c == '\n'; }
-    );
-  location_.column += lastRead.size() - lastRead.find_last_of('\n');
+bool FileParser::Parse(Scene& scene) {
+  if (!Open()) return false;
+  //compiled by harmc, there is nothing to parse
+  if (IsSceneFile(text_.begin(), text_.end())) {
+    if (!ReadSceneFile(text_.begin(), text_.end(), scene, timeDelta_,
+          blockHashes, &locationMap)) {
+      Error("Bad scene file, from another version of harmc?");
+    }
+  } else {
+    //every range is logged, which needs the lines anyway
+    Sources().IndexLines(fileId_, text_.begin(), text_.end());
+    lexer_ = Lexer(text_.begin(), text_.end());
+    SceneSink sink(*this, scene);
+    ReadCurrentInput(*this, sink);
+  }
+  Close();
+  return true;
 }
 
-void HarmonogramParser::Error(const string& function, const string& message) {
-  cout << function << "(): " << message << " at: " << GetCursor() << endl;
-  assert(false);
+bool FileParser::Parse(PendulumSink& sink) {
+  if (!Open()) return false;
+  if (IsSceneFile(text_.begin(), text_.end())) {
+    ParseSceneFile(sink);
+  } else {
+    lexer_ = Lexer(text_.begin(), text_.end());
+    ReadCurrentInput(*this, sink);
+  }
+  Close();
+  return true;
 }
 
-string HarmonogramParser::GetCursor() {
-  return location_.ToString();
+/*
+ * Every compound has to be made of the SimplePendulums just before it, which
+ * is how harmc writes the .harm files it's given.
+ */
+bool FileParser::ParseSceneFile(PendulumSink& sink) {
+  Scene scene;
+  map<PendulumId, uint64_t> hashes;
+  map<PendulumId, Range> locations;
+  if (!ReadSceneFile(text_.begin(), text_.end(), scene, timeDelta_, hashes,
+        &locations)) {
+    Error("Bad scene file, from another version of harmc?");
+    return false;
+  }
+  const vector<PendulumHandle>& order = scene.Handles();
+  //where each pendulum is in order, by kind and index
+  vector<size_t> simplePositions, compoundPositions;
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (order[i].kind == PendulumHandle::kSimple) simplePositions.push_back(i);
+    else compoundPositions.push_back(i);
+  }
+  //the compound each pendulum (by position) is a child of
+  const size_t kNoParent = (size_t)-1;
+  vector<size_t> parents(order.size(), kNoParent);
+  vector<size_t> childCounts(compoundPositions.size(), 0);
+  for (const auto& edge : scene.Children()) {
+    if (edge.second.kind != PendulumHandle::kSimple) {
+      Error("This scene file has compounds made of compounds, "
+            "it can't be read a pendulum at a time");
+      return false;
+    }
+    size_t& parent = parents[simplePositions[edge.second.index]];
+    if (parent != kNoParent) {
+      Error("This scene file has pendulums shared by compounds, "
+            "it can't be read a pendulum at a time");
+      return false;
+    }
+    parent = edge.first.index;
+    ++childCounts[edge.first.index];
+  }
+  for (size_t c = 0; c < compoundPositions.size(); ++c) {
+    size_t position = compoundPositions[c];
+    bool madeOfPrevious = childCounts[c] <= position;
+    for (size_t i = position - childCounts[c]; madeOfPrevious && i < position;
+        ++i) {
+      madeOfPrevious = parents[i] == c;
+    }
+    if (!madeOfPrevious) {
+      Error("This scene file's compounds aren't made of the pendulums "
+            "just before them, it can't be read a pendulum at a time");
+      return false;
+    }
+  }
+
+  auto rangeOf = [&](const string& name) {
+    auto range = locations.find(name);
+    return (range == locations.end()) ? Range() : range->second;
+  };
+  for (PendulumHandle handle : order) {
+    PendulumBase& pendulum = scene[handle];
+    uint64_t hash = hashes[pendulum.name];
+    Range range = rangeOf(pendulum.name);
+    if (handle.kind == PendulumHandle::kSimple) {
+      sink.OnPendulum(move(static_cast<SimplePendulum&>(pendulum)), range,
+          hash);
+    } else {
+      sink.OnCompound(move(static_cast<CompoundPendulum&>(pendulum)),
+          childCounts[handle.index], range, hash);
+    }
+  }
+  return true;
 }
 
-list<PendulumPtr> HarmonogramParser::Parse(const list<string>& fileNameList) {
-  locationMap.clear();
-  lastRead = "";
-  list<PendulumPtr> pendulumPtrList;
+void FileParser::Release() {
+  //a page at a time would be a system call every few pendulums
+  const size_t kReleaseStep = 1 << 20;
+  //a buffer belongs to whoever handed it over
+  if (inMemory_) return;
+  if (lexer_.Offset() >= released_ + kReleaseStep) {
+    released_ = lexer_.Offset();
+    CountLines(released_);
+    file_.Release(released_);
+  }
+}
+
+ParsedFile ParseWith(FileParser& parser) {
+  ParsedFile file;
+  file.opened = parser.Parse(file.scene);
+  file.locationMap = move(parser.locationMap);
+  file.blockHashes = move(parser.blockHashes);
+  file.diagnostics = move(parser.diagnostics);
+  file.log = parser.log.str();
+  return file;
+}
+
+ParsedFile pendulumNames::ParseFile(const string& fileName, double timeDelta) {
+  FileParser parser(fileName, timeDelta);
+  return ParseWith(parser);
+}
+
+ParsedFile pendulumNames::ParseBuffer(const string& name,
+    const StringSlice& text, double timeDelta) {
+  FileParser parser(name, text, timeDelta);
+  return ParseWith(parser);
+}
+
+//From the HarmonogramParser class
+
+HarmonogramParser::HarmonogramParser(size_t threadCount)
+  : timeDelta(PendulumBase::timeDelta), pool_(threadCount) {}
+
+/*
+ * Every file gets its own FileParser and Scene, on the pool.  They are merged
+ * in the order they were given (and their logs printed then), so that the
+ * result is the same as reading the files one after the other.
+ */
+void HarmonogramParser::Parse(const list<string>& fileNameList, Scene& scene) {
+  vector<future<ParsedFile>> parsed;
+  double timeDelta = this->timeDelta;
   for (const auto& fileName : fileNameList) {
-    cout << "parsing: " << fileName << endl;
-    location_.Reset();
-    location_.fileName = fileName;
-    ifstream file(fileName);
-    if (!file.good()) {
-      cout << "couldn't open file: " << fileName << endl;
-      file.close();
+    parsed.push_back(pool_.Submit([fileName, timeDelta]() {
+      return ParseFile(fileName, timeDelta);
+    }));
+  }
+  Merge(parsed, fileNameList, scene);
+}
+
+//the buffers stay put until every one of them has been merged
+void HarmonogramParser::Parse(const vector<NamedBuffer>& buffers,
+    Scene& scene) {
+  vector<future<ParsedFile>> parsed;
+  list<string> names;
+  double timeDelta = this->timeDelta;
+  for (const auto& buffer : buffers) {
+    const NamedBuffer* source = &buffer;
+    parsed.push_back(pool_.Submit([source, timeDelta]() {
+      return ParseBuffer(source->name,
+          StringSlice{source->text.data(), source->text.size()}, timeDelta);
+    }));
+    names.push_back(buffer.name);
+  }
+  Merge(parsed, names, scene);
+}
+
+void HarmonogramParser::Merge(vector<future<ParsedFile>>& parsed,
+    const list<string>& fileNameList, Scene& scene) {
+  locationMap.clear();
+  blockHashes.clear();
+  fileStarts.clear();
+  diagnostics.clear();
+  unopened.clear();
+  scene.Clear();
+  auto fileName = fileNameList.begin();
+  for (auto& result : parsed) {
+    ParsedFile file = result.get();
+    fileStarts.push_back(scene.size());
+    cout << "parsing: " << *fileName << endl;
+    if (!file.opened) {
+      cout << "couldn't open file: " << *fileName << endl;
+      unopened.push_back(*fileName++);
       continue;
     }
-    input_ = &file;
-    //read the pendulums from the file
-    pendulumPtrList.splice(pendulumPtrList.end(), 
-        move(ReadCurrentInput(*this)));
-    file.close();
+    ++fileName;
+    cout << file.log;
+    for (auto& diagnostic : file.diagnostics) {
+      cout << diagnostic.ToString() << endl;
+      diagnostics.push_back(move(diagnostic));
+    }
+    //the first file's maps are taken whole, there is nothing to overwrite
+    if (locationMap.empty()) locationMap.swap(file.locationMap);
+    if (blockHashes.empty()) blockHashes.swap(file.blockHashes);
+    for (auto& p : file.locationMap) {
+      if (locationMap.count(p.first)) {
+        cout << "warning, overwriting node: " << p.first << endl;
+      }
+      locationMap[p.first] = move(p.second);
+    }
+    for (const auto& p : file.blockHashes) blockHashes[p.first] = p.second;
+    scene.Append(move(file.scene));
+  }
+  fileStarts.push_back(scene.size());
+  if (!scene.Link()) {
+    for (auto& diagnostic : CycleDiagnostics(scene, locationMap)) {
+      cout << diagnostic.ToString() << endl;
+      diagnostics.push_back(move(diagnostic));
+    }
   }
-  return pendulumPtrList;
 }
 
 //
 
-Color ReadColor(HarmonogramParser& parser) {
+Color ReadColor(FileParser& parser) {
   Color color;
-  parser.GetStream() >> color.R;
+  ReadDouble(parser, color.R);
   ReadCommaDouble(parser, color.G);
   ReadCommaDouble(parser, color.B);
   ReadCommaDouble(parser, color.A);
   return color;
 }
 
-void ReadCommaDouble(HarmonogramParser& parser, double& d) {
+void ReadCommaDouble(FileParser& parser, double& d) {
   parser.Advance();
-  switch (StringToTokenName(parser.GetToken())) {
-    case kTokComma : parser.GetStream() >> d; break;
-    default : parser.Error( __func__, "Expected a ','");
+  switch (parser.GetToken()) {
+    case kTokComma : ReadDouble(parser, d); break;
+    default : parser.Error("Expected a ','");
   }
 }
 
-void ReadComment(HarmonogramParser& parser) {
+void ReadComment(FileParser& parser) {
   while (parser.Good()) {
     parser.Advance();
-    switch (StringToTokenName(parser.GetToken())) {
+    switch (parser.GetToken()) {
       case kTokCommentEnd : return; break;
       default : continue;
     }
   }
-  parser.Error( __func__, "Expected '*/'");
+  parser.Error("Expected '*/'");
 }
 
-list<PendulumPtr> ReadCurrentInput(HarmonogramParser& parser) {
-  unique_ptr<CompoundPendulum> compoundPtr(new CompoundPendulum());
-  double& cyclesRef = compoundPtr->cycles_;
-  list<PendulumPtr> pendulumPtrList;
+//FNV-1a
+uint64_t HashText(uint64_t hash, const StringSlice& text) {
+  for (char c : text) {
+    hash ^= (unsigned char)c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+const uint64_t kEmptyHash = 0xcbf29ce484222325ull;
+
+/*
+ * Every file is one CompoundPendulum, made of the SimplePendulums in it.
+ *
+ * A SimplePendulum's block hash is that of the text from its '{' to its '}'.
+ * The CompoundPendulum is made of all of them, so its hash is that of the
+ * whole file.
+ *
+ * A pendulum with an error in it is left out, and the parse carries on from
+ * the next '{'.
+ *
+ * Nothing is kept of a pendulum once it's handed to the sink: the file's
+ * hash is worked out as it goes, so that the text can be let go.
+ */
+void ReadCurrentInput(FileParser& parser, PendulumSink& sink) {
+  CompoundPendulum compound;
+  double& cyclesRef = compound.cycles_;
+  size_t children = 0;
   Location startLocation = parser.GetLocation();
   bool read = false;
-  Range range;
-  while (parser.Good() && !read) {
-    parser.Advance();
+  Lexer& lexer = parser.GetLexer();
+  //the hash of the file up to "hashed"
+  uint64_t fileHash = kEmptyHash;
+  size_t hashed = 0;
+  while (!read) {
+    //Recover() leaves the lexer on the next '{'
+    if (!parser.Recover()) parser.Advance();
     Location location = parser.GetLocation();
-    switch (StringToTokenName(parser.GetToken())) {
-      case kTokPendulumBegin :
-        pendulumPtrList.push_back(move(ReadPendulum(parser)));
-        if (!pendulumPtrList.back()->IsValid()) {
-          parser.Error( __func__, "Invalid Pendulum");
-        } 
-        if (parser.locationMap.count(pendulumPtrList.back()->name)) {
-          cout << "warning, overwriting node: " << 
-            pendulumPtrList.back()->name << endl;
+    switch (parser.GetToken()) {
+      case kTokPendulumBegin : {
+        size_t blockBegin = lexer.Offset() - lexer.TokenText().size;
+        SimplePendulum pendulum = ReadPendulum(parser);
+        if (parser.Failed()) break;
+        if (!pendulum.IsValid()) {
+          parser.Error("Invalid Pendulum");
+          break;
         }
-        range = Range{move(location), move(parser.GetLocation())};
-        cout << pendulumPtrList.back()->name << " -> " << range.ToString() << endl;
-        parser.locationMap[pendulumPtrList.back()->name] = range;
-        break;
-      case kTokCenter : compoundPtr->center = ReadPosition(parser); break;
-      case kTokColor : compoundPtr->color = ReadColor(parser); break;
+        uint64_t hash =
+          HashText(kEmptyHash, lexer.Text(blockBegin, lexer.Offset()));
+        fileHash = HashText(fileHash, lexer.Text(hashed, lexer.Offset()));
+        hashed = lexer.Offset();
+        sink.OnPendulum(move(pendulum),
+            Range{move(location), parser.GetLocation()}, hash);
+        ++children;
+        parser.Release();
+      } break;
+      case kTokCenter : compound.center = ReadPosition(parser); break;
+      case kTokColor : compound.color = ReadColor(parser); break;
       case kTokCommentBegin : ReadComment(parser); break;
-      case kTokCycles: parser.GetStream() >> cyclesRef; break;
+      case kTokCycles: ReadDouble(parser, cyclesRef); break;
       case kTokName : {
-                        compoundPtr->name = ReadIdentifier(parser); 
+                        compound.name = ReadIdentifier(parser); 
                       } break;
       default : 
-        if (parser.Good()) parser.Error( __func__, "Expected '{' or '/*'");
+        if (parser.Good()) parser.Error("Expected '{' or '/*'");
         else read = true;
     }
   }
-  for (auto& pendulumPtr : pendulumPtrList) {
-    compoundPtr->AddPendulum(pendulumPtr.get());
-  }
-  compoundPtr->SetPreferredBufferSize();
-  parser.locationMap[compoundPtr->name] = Range{startLocation, parser.GetLocation()};
-  pendulumPtrList.push_back(move(compoundPtr));
-  return pendulumPtrList;
+  fileHash = HashText(fileHash, lexer.Text(hashed, lexer.Offset()));
+  sink.OnCompound(move(compound), children,
+      Range{startLocation, parser.GetLocation()}, fileHash);
 }
 
-string ReadIdentifier(HarmonogramParser& parser) {
-  string id;
-  parser.GetStream() >> std::ws;
-  while (parser.Good() && isalnum(parser.GetStream().peek())) {
-      id.push_back(parser.GetStream().get());
+void ReadDouble(FileParser& parser, double& d) {
+  if (parser.Failed()) return;
+  if (!parser.GetLexer().ReadDouble(d)) {
+    parser.Error(DecimalStatusMessage(parser.GetLexer().NumberStatus()));
   }
-  return id;
 }
 
-PendulumPtr ReadPendulum(HarmonogramParser& parser) {
-  unique_ptr<SimplePendulum> pendulumPtr(new SimplePendulum());
-  Location location = parser.GetLocation();
+string ReadIdentifier(FileParser& parser) {
+  return parser.GetLexer().ReadIdentifier().ToString();
+}
+
+SimplePendulum ReadPendulum(FileParser& parser) {
+  SimplePendulum pendulum;
   bool read = false;
   double startPhase;
   while (parser.Good() && !read && 
-      StringToTokenName(parser.GetToken()) != kTokPendulumEnd) {
+      parser.GetToken() != kTokPendulumEnd) {
     parser.Advance();
-    switch (StringToTokenName(parser.GetToken())) {
-      case kTokType : pendulumPtr->type = ReadType(parser); break;
-      case kTokName : pendulumPtr->name = ReadIdentifier(parser); 
+    switch (parser.GetToken()) {
+      case kTokType : pendulum.type = ReadType(parser); break;
+      case kTokName : pendulum.name = ReadIdentifier(parser); 
                       break;
-      case kTokCenter : pendulumPtr->center = ReadPosition(parser); break;
-      case kTokFrequency : parser.GetStream() >> pendulumPtr->frequency.value;
+      case kTokCenter : pendulum.center = ReadPosition(parser); break;
+      case kTokFrequency : ReadDouble(parser, pendulum.frequency.value);
                            break;
-      case kTokColor : pendulumPtr->color = ReadColor(parser); break;
-      case kTokStartPhase : parser.GetStream() >> startPhase;
-                            pendulumPtr->frequency.SetStartPhase(startPhase);
+      case kTokColor : pendulum.color = ReadColor(parser); break;
+      case kTokStartPhase : ReadDouble(parser, startPhase);
+                            pendulum.frequency.SetStartPhase(startPhase);
                             break;
-      case kTokDirection : pendulumPtr->direction = ReadPosition(parser); break;
-      case kTokAmplitude : parser.GetStream() >> pendulumPtr->amplitude; break;
+      case kTokDirection : pendulum.direction = ReadPosition(parser); break;
+      case kTokAmplitude : ReadDouble(parser, pendulum.amplitude); break;
       case kTokPendulumEnd: read = true; break;
       case kTokCommentBegin : ReadComment(parser); break;
       default :
-        cout << parser.GetToken() << endl;
-        parser.Error( __func__, "Expected an Attribute");
+        if (!parser.Good()) break;
+        parser.Error("Expected an Attribute, not '" +
+            parser.GetLexer().TokenText().ToString() + "'");
     }
   }
-  pendulumPtr->SetPreferredBufferSize();
-  return move(pendulumPtr);
+  if (!read) {
+    parser.Error("Expected '}'");
+    return pendulum;
+  }
+  pendulum.SetPreferredBufferSize(parser.TimeDelta());
+  return pendulum;
 }
 
-Position ReadPosition(HarmonogramParser& parser) {
+Position ReadPosition(FileParser& parser) {
   Position position;
-  parser.GetStream() >> position.x;
+  ReadDouble(parser, position.x);
   parser.Advance();
-  switch (StringToTokenName(parser.GetToken())) {
-    case kTokComma : parser.GetStream() >> position.y; break;
-    default: parser.Error( __func__, "Expected a ','");
+  switch (parser.GetToken()) {
+    case kTokComma : ReadDouble(parser, position.y); break;
+    default: parser.Error("Expected a ','");
   }
   return position;
 }
 
-SimplePendulum::Type ReadType(HarmonogramParser& parser) {
+SimplePendulum::Type ReadType(FileParser& parser) {
   //parser.Advance();
-  string typeName;
-  typeName = ReadIdentifier(parser);
-  for (auto& c : typeName) c = tolower(c);
-  switch (StringToTokenName(typeName)) {
+  switch (SliceToTokenName(parser.GetLexer().ReadIdentifier())) {
     case kTokOscillation : return SimplePendulum::kOscillation; break;
     case kTokRotation : return SimplePendulum::kRotation; break;
-    default : parser.Error( __func__, "Expected a SimplePendulum::Type"); 
+    default : parser.Error("Expected 'rotation' or 'oscillation'"); 
               return SimplePendulum::kInvalid;
   }
 }
@@ -0,0 +1,147 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace profilerNames {
+
+const FrameProfiler::Frame kEmptyFrame = {};
+
+FrameProfiler::FrameProfiler(size_t frameCount) :
+    showOverlay(false), frames_(max<size_t>(frameCount, 2), kEmptyFrame),
+    current_(0), completed_(0), lastFrameEnd_(Now()),
+    queueDrawTime_(lastFrameEnd_), drawQueued_(false) {
+  scratch_.reserve(frames_.size());
+}
+
+const char* FrameProfiler::SectionName(Section section) {
+  switch (section) {
+    case kFrame : return "frame";
+    case kUpdate : return "update";
+    case kQueueDraw : return "queue_draw";
+    case kDraw : return "draw";
+    case kPlainDraw : return "plain_draw";
+    case kFadeDraw : return "fade_draw";
+    case kRainbowDraw : return "rainbow_draw";
+    case kCenterDraw : return "center_draw";
+    default : return "invalid";
+  }
+}
+
+void FrameProfiler::EndFrame() {
+  TimePoint now = Now();
+  frames_[current_].ms[kFrame] = Milliseconds(lastFrameEnd_, now);
+  lastFrameEnd_ = now;
+  ++current_ %= frames_.size();
+  frames_[current_] = kEmptyFrame;
+  if (completed_ < frames_.size() - 1) ++completed_;
+}
+
+//only the first queue_draw() of a frame counts, later ones are coalesced
+void FrameProfiler::MarkQueueDraw() {
+  if (drawQueued_) return;
+  queueDrawTime_ = Now();
+  drawQueued_ = true;
+}
+
+void FrameProfiler::MarkDrawStart() {
+  if (!drawQueued_) return;
+  Add(kQueueDraw, queueDrawTime_);
+  drawQueued_ = false;
+}
+
+size_t FrameProfiler::FrameCount() const { return completed_; }
+
+const FrameProfiler::Frame& FrameProfiler::GetFrame(size_t i) const {
+  assert(i < completed_);
+  return frames_[(current_ + frames_.size() - completed_ + i) % frames_.size()];
+}
+
+/*
+ * Bins [0, maxMs) evenly, the last bin also counts everything above maxMs.
+ * The histogram is filled in place, so that the overlay doesn't allocate
+ * every frame.
+ */
+void FrameProfiler::Histogram(Section section, double maxMs,
+    vector<size_t>& histogram) const {
+  size_t bins = histogram.size();
+  fill(histogram.begin(), histogram.end(), 0);
+  if (bins == 0) return;
+  for (size_t i = 0; i < FrameCount(); ++i) {
+    size_t bin = (size_t)(GetFrame(i).ms[section]/maxMs*bins);
+    ++histogram[min(bin, bins - 1)];
+  }
+}
+
+//nearest rank percentile, fraction is in [0,1]
+double FrameProfiler::Percentile(Section section, double fraction) const {
+  if (FrameCount() == 0) return 0;
+  scratch_.clear();
+  for (size_t i = 0; i < FrameCount(); ++i) {
+    scratch_.push_back(GetFrame(i).ms[section]);
+  }
+  size_t rank = (size_t)ceil(fraction*scratch_.size());
+  rank = min(max<size_t>(rank, 1), scratch_.size()) - 1;
+  nth_element(scratch_.begin(), scratch_.begin() + rank, scratch_.end());
+  return scratch_[rank];
+}
+
+bool FrameProfiler::DumpCsv(const string& fileName) const {
+  ofstream file(fileName);
+  if (!file.good()) {
+    cout << "couldn't open file: " << fileName << endl;
+    return false;
+  }
+  file << "index";
+  for (int s = 0; s < kSectionCount; ++s) {
+    file << "," << SectionName((Section)s) << "_ms";
+  }
+  file << '\n';
+  for (size_t i = 0; i < FrameCount(); ++i) {
+    file << i;
+    for (double ms : GetFrame(i).ms) file << "," << ms;
+    file << '\n';
+  }
+  return file.good();
+}
+
+bool FrameProfiler::DumpJson(const string& fileName) const {
+  ofstream file(fileName);
+  if (!file.good()) {
+    cout << "couldn't open file: " << fileName << endl;
+    return false;
+  }
+  file << "{\n  \"unit\": \"ms\",\n  \"summary\": {";
+  for (int s = 0; s < kSectionCount; ++s) {
+    Section section = (Section)s;
+    file << (s ? "," : "") << "\n    \"" << SectionName(section) << "\": {"
+         << "\"p50\": " << Percentile(section, .5) << ", "
+         << "\"p90\": " << Percentile(section, .9) << ", "
+         << "\"p99\": " << Percentile(section, .99) << ", "
+         << "\"max\": " << Percentile(section, 1) << "}";
+  }
+  file << "\n  },\n  \"sections\": [";
+  for (int s = 0; s < kSectionCount; ++s) {
+    file << (s ? ", " : "") << "\"" << SectionName((Section)s) << "\"";
+  }
+  file << "],\n  \"frames\": [";
+  for (size_t i = 0; i < FrameCount(); ++i) {
+    file << (i ? "," : "") << "\n    [";
+    const Frame& frame = GetFrame(i);
+    for (int s = 0; s < kSectionCount; ++s) {
+      file << (s ? ", " : "") << frame.ms[s];
+    }
+    file << "]";
+  }
+  file << "\n  ]\n}\n";
+  return file.good();
+}
+
+}; //namespace profilerNames
@@ -0,0 +1,50 @@
+#include "range_index.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace pendulumNames;
+using namespace std;
+
+void RangeIndex::Clear() {
+  files_.clear();
+}
+
+void RangeIndex::Insert(size_t id, const Range& range) {
+  if (!range.Valid()) return;
+  files_[range.begin.file].push_back(
+      Entry{range.begin.offset, range.end.offset, id, kNone});
+}
+
+/*
+ * The entries are sorted outer first, so the ranges still open when one
+ * begins are on the stack, innermost on top, and the first of them that
+ * reaches past its end is its parent.
+ */
+void RangeIndex::Build() {
+  for (auto& file : files_) {
+    vector<Entry>& entries = file.second;
+    sort(entries.begin(), entries.end(), [](const Entry& l, const Entry& r) {
+      return (l.begin != r.begin) ? l.begin < r.begin : l.end > r.end;
+    });
+    vector<size_t> open;
+    for (size_t i = 0; i < entries.size(); ++i) {
+      while (!open.empty() && entries[open.back()].end < entries[i].end) {
+        open.pop_back();
+      }
+      entries[i].parent = open.empty() ? kNone : open.back();
+      open.push_back(i);
+    }
+  }
+}
+
+size_t RangeIndex::Innermost(const Location& where) const {
+  auto file = files_.find(where.file);
+  if (file == files_.end()) return kNone;
+  const vector<Entry>& entries = file->second;
+  auto after = upper_bound(entries.begin(), entries.end(), where.offset,
+      [](size_t offset, const Entry& entry) { return offset < entry.begin; });
+  size_t i = (after == entries.begin()) ? kNone : after - entries.begin() - 1;
+  while (i != kNone && entries[i].end < where.offset) i = entries[i].parent;
+  return (i == kNone) ? kNone : entries[i].id;
+}
@@ -0,0 +1,235 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ringbuffer.h"
+#include "spsc_ringbuffer.h"
+
+using namespace std;
+
+/*
+ * Micro-benchmark for the RingBuffer.  The LegacyRingBuffer is the original
+ * modulo-based implementation, kept here only to have something to compare
+ * against.
+ *
+ * Also stress tests the SpscRingBuffer with a real producer and consumer
+ * thread, and reports its throughput.  Returns 1 if the stress test saw a
+ * torn, out of order or unaccounted for value.
+ */
+
+struct Sample {
+  double x;
+  double y;
+
+  Sample& operator+=(const Sample& rhs) {
+    x += rhs.x;
+    y += rhs.y;
+    return *this;
+  }
+};
+
+Sample operator+(Sample lhs, const Sample& rhs) { return lhs += rhs; }
+Sample operator-(Sample lhs, const Sample& rhs) {
+  return lhs += Sample{-rhs.x, -rhs.y};
+}
+
+template<typename T>
+class LegacyRingBufferIterator {
+ public:
+  size_t pos;
+  vector<T>* ptr;
+  size_t& operator++() {
+    ++pos %= ptr->size();
+    return pos;
+  }
+  T& operator*() { return (*ptr)[pos]; }
+  bool operator==(const LegacyRingBufferIterator& l) const { return pos == l.pos; }
+  bool operator!=(const LegacyRingBufferIterator& l) const { return !(*this == l); }
+};
+
+template<typename T>
+class LegacyRingBuffer {
+ public:
+  using Iterator = LegacyRingBufferIterator<T>;
+
+  LegacyRingBuffer() : front_index(0), buffer() {}
+
+  Iterator begin() {
+    if (front_index == buffer.size() - 1) return Iterator{0, &buffer};
+    else return {front_index + 1, &buffer};
+  }
+
+  Iterator end() { return {front_index, &buffer}; }
+
+  void Push(const T& position) {
+    if (buffer.size() == 0) {
+      buffer.push_back(position);
+    } else {
+      ++front_index %= buffer.size();
+      buffer[front_index] = position;
+    }
+  }
+
+  void Fill(size_t size, const T& pos) {
+    buffer.clear();
+    buffer.reserve(size);
+    for(size_t i = 0; i < size; ++i) buffer.push_back(pos);
+  }
+
+  void Translate(const T& p) {
+    for (auto& pos : buffer) { pos += p; }
+  }
+
+  size_t front_index;
+  vector<T> buffer;
+};
+
+//keeps the optimizer from throwing the work away
+volatile double sink;
+
+double TimeIt(const function<void()>& f, size_t repetitions) {
+  auto begin = chrono::steady_clock::now();
+  for (size_t i = 0; i < repetitions; ++i) f();
+  auto end = chrono::steady_clock::now();
+  return chrono::duration<double, nano>(end - begin).count()/repetitions;
+}
+
+void Report(const string& name, double legacyNs, double ringNs) {
+  cout << setw(12) << left << name << right
+       << setw(14) << fixed << setprecision(1) << legacyNs
+       << setw(14) << ringNs
+       << setw(10) << setprecision(2) << legacyNs/ringNs << "x" << endl;
+}
+
+/*
+ * Each test touches "samples" values, the times are per call of the test.
+ */
+void Benchmark(size_t samples, size_t repetitions) {
+  LegacyRingBuffer<Sample> legacy;
+  RingBuffer<Sample> ring;
+  legacy.Fill(samples, {0, 0});
+  ring.Fill(samples, {0, 0});
+
+  cout << "samples: " << samples << ", repetitions: " << repetitions << endl;
+  cout << setw(12) << left << "test" << right << setw(14) << "legacy ns"
+       << setw(14) << "ring ns" << setw(11) << "speedup" << endl;
+
+  double x = 0;
+  double legacyNs = TimeIt([&]() {
+      for (size_t i = 0; i < samples; ++i) legacy.Push({x, x}), x += 1;
+    }, repetitions);
+  double ringNs = TimeIt([&]() {
+      for (size_t i = 0; i < samples; ++i) ring.Push({x, x}), x += 1;
+    }, repetitions);
+  Report("Push", legacyNs, ringNs);
+
+  legacyNs = TimeIt([&]() {
+      double sum = 0;
+      for (auto it = legacy.begin(); it != legacy.end(); ++it) sum += (*it).x;
+      sink = sum;
+    }, repetitions);
+  ringNs = TimeIt([&]() {
+      double sum = 0;
+      for (const auto& span : ring.Spans()) {
+        for (const Sample& s : span) sum += s.x;
+      }
+      sink = sum;
+    }, repetitions);
+  Report("Iterate", legacyNs, ringNs);
+
+  legacyNs = TimeIt([&]() { legacy.Translate({1, -1}); }, repetitions);
+  ringNs = TimeIt([&]() { ring.Translate({1, -1}); }, repetitions);
+  Report("Translate", legacyNs, ringNs);
+
+  //what the lazy Translate defers, one pass over the storage
+  ringNs = TimeIt([&]() { ring.Translate({1, -1}); ring.Fold(); }, repetitions);
+  Report("Fold", legacyNs, ringNs);
+  cout << endl;
+}
+
+//check is derived from seq, so a torn copy is (almost certainly) noticed
+struct Stamp {
+  uint64_t seq;
+  uint64_t check;
+};
+
+Stamp MakeStamp(uint64_t seq) { return {seq, seq*0x9E3779B97F4A7C15ull}; }
+bool Valid(const Stamp& s) { return s.check == s.seq*0x9E3779B97F4A7C15ull; }
+
+/*
+ * The producer pushes "count" stamps as fast as it can, while the consumer
+ * alternates between Drain() and CopyLatest(snapshot), checking that every
+ * value is whole and in order.  Drain() has to hand over every stamp it
+ * doesn't count as dropped: each one is the last plus one, plus however many
+ * were dropped in between.
+ */
+bool SpscStress(size_t capacity, size_t count, size_t snapshot) {
+  SpscRingBuffer<Stamp> ring(capacity);
+  atomic<bool> done(false);
+  size_t errors = 0, drained = 0, snapshots = 0;
+
+  auto begin = chrono::steady_clock::now();
+  thread producer([&]() {
+    for (uint64_t seq = 1; seq <= count; ++seq) ring.Push(MakeStamp(seq));
+    done = true;
+  });
+
+  vector<Stamp> latest(snapshot);
+  uint64_t lastSeq = 0;
+  size_t lastDropped = 0;
+  auto check = [&](const Stamp& s) {
+    if (!Valid(s) || s.seq != lastSeq + 1 + (ring.Dropped() - lastDropped)) {
+      ++errors;
+    }
+    lastSeq = s.seq;
+    lastDropped = ring.Dropped();
+    ++drained;
+  };
+  while (!done || ring.Pushed() != lastSeq) {
+    ring.Drain(check);
+    size_t n = ring.CopyLatest(latest.data(), snapshot);
+    ++snapshots;
+    for (size_t i = 0; i < n; ++i) {
+      if (!Valid(latest[i]) || latest[i].seq > count) ++errors;
+      if (i > 0 && latest[i].seq != latest[i - 1].seq + 1) ++errors;
+    }
+  }
+  producer.join();
+  auto end = chrono::steady_clock::now();
+
+  double seconds = chrono::duration<double>(end - begin).count();
+  cout << "spsc capacity: " << capacity << ", pushed: " << count
+       << ", drained: " << drained << ", dropped: " << ring.Dropped()
+       << ", snapshots: " << snapshots << endl;
+  cout << "  " << fixed << setprecision(1) << count/seconds/1e6
+       << " M pushes/s, " << snapshots/seconds/1e3 << " k snapshots/s, "
+       << (errors ? "FAILED" : "ok") << " (" << errors << " errors)" << endl;
+  return errors == 0 && drained + ring.Dropped() == count;
+}
+
+//the producer alone, the cost of a Push without a reader
+void SpscThroughput(size_t capacity, size_t count) {
+  SpscRingBuffer<Stamp> ring(capacity);
+  double ns = TimeIt([&]() {
+      for (uint64_t seq = 0; seq < count; ++seq) ring.Push(MakeStamp(seq));
+    }, 1);
+  cout << "spsc uncontended push: " << fixed << setprecision(2)
+       << ns/count << " ns" << endl;
+}
+
+int main(int argc, char** argv) {
+  //neither is a power of two, which is the common case for the pendulums
+  Benchmark(1000, 20000);
+  Benchmark(100000, 200);
+
+  SpscThroughput(1024, 50000000);
+  bool ok = SpscStress(1024, 20000000, 64);
+  ok = SpscStress(64, 20000000, 60) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace pendulumNames;
+using namespace std;
+
+PendulumHandle Scene::Add(SimplePendulum pendulum) {
+  PendulumHandle handle{PendulumHandle::kSimple, (uint32_t)simples_.size()};
+  simples_.push_back(move(pendulum));
+  order_.push_back(handle);
+  return handle;
+}
+
+PendulumHandle Scene::Add(CompoundPendulum compound) {
+  PendulumHandle handle{PendulumHandle::kCompound, (uint32_t)compounds_.size()};
+  compounds_.push_back(move(compound));
+  order_.push_back(handle);
+  return handle;
+}
+
+void Scene::AddChild(PendulumHandle compound, PendulumHandle child) {
+  assert(compound.kind == PendulumHandle::kCompound && child.Valid());
+  children_.emplace_back(compound, child);
+}
+
+void Scene::Append(Scene&& other) {
+  uint32_t simpleBase = simples_.size();
+  uint32_t compoundBase = compounds_.size();
+  auto shift = [&](PendulumHandle handle) {
+    handle.index += (handle.kind == PendulumHandle::kSimple) ?
+        simpleBase : compoundBase;
+    return handle;
+  };
+  simples_.reserve(simples_.size() + other.simples_.size());
+  for (auto& pendulum : other.simples_) simples_.push_back(move(pendulum));
+  compounds_.reserve(compounds_.size() + other.compounds_.size());
+  for (auto& compound : other.compounds_) compounds_.push_back(move(compound));
+  for (PendulumHandle handle : other.order_) order_.push_back(shift(handle));
+  for (const auto& edge : other.children_) {
+    children_.emplace_back(shift(edge.first), shift(edge.second));
+  }
+  other.Clear();
+}
+
+void Scene::AppendCopy(const Scene& other, size_t begin, size_t end) {
+  assert(begin <= end && end <= other.order_.size());
+  //other's handles to those of the copies
+  vector<PendulumHandle> simpleCopies(other.simples_.size(), kNoPendulum);
+  vector<PendulumHandle> compoundCopies(other.compounds_.size(), kNoPendulum);
+  for (size_t i = begin; i < end; ++i) {
+    PendulumHandle handle = other.order_[i];
+    switch (handle.kind) {
+      case PendulumHandle::kSimple :
+        simpleCopies[handle.index] = Add(other.simples_[handle.index]); break;
+      case PendulumHandle::kCompound :
+        compoundCopies[handle.index] = Add(other.compounds_[handle.index]);
+        break;
+      default : assert(false && "Scene::AppendCopy");
+    }
+  }
+  auto copyOf = [&](PendulumHandle handle) {
+    return (handle.kind == PendulumHandle::kSimple) ?
+        simpleCopies[handle.index] : compoundCopies[handle.index];
+  };
+  for (const auto& edge : other.children_) {
+    PendulumHandle compound = copyOf(edge.first);
+    PendulumHandle child = copyOf(edge.second);
+    if (compound.Valid() && child.Valid()) AddChild(compound, child);
+  }
+}
+
+void Scene::Replace(PendulumHandle handle, const Scene& other,
+    PendulumHandle from) {
+  assert(handle.kind == from.kind);
+  switch (handle.kind) {
+    case PendulumHandle::kSimple :
+      simples_[handle.index] = other.simples_[from.index]; break;
+    //the copied children's pointers are replaced by Link()
+    case PendulumHandle::kCompound :
+      compounds_[handle.index] = other.compounds_[from.index]; break;
+    default : assert(false && "Scene::Replace");
+  }
+}
+
+void Scene::Clear() {
+  simples_.clear();
+  compounds_.clear();
+  order_.clear();
+  children_.clear();
+  compoundOrder_.clear();
+  cyclic_.clear();
+}
+
+void Scene::Reserve(size_t simples, size_t compounds) {
+  simples_.reserve(simples_.size() + simples);
+  compounds_.reserve(compounds_.size() + compounds);
+  order_.reserve(order_.size() + simples + compounds);
+}
+
+PendulumHandle Scene::Find(const string& name) const {
+  for (PendulumHandle handle : order_) {
+    if ((*this)[handle].name == name) return handle;
+  }
+  return kNoPendulum;
+}
+
+bool Scene::Link() {
+  for (auto& compound : compounds_) compound.ClearPendulums();
+  for (const auto& edge : children_) {
+    compounds_[edge.first.index].AddPendulum(&(*this)[edge.second]);
+  }
+  SortCompounds();
+  //a compound's buffer size depends on its children's
+  for (uint32_t i : compoundOrder_) compounds_[i].SetPreferredBufferSize();
+  cyclic_.clear();
+  if (compoundOrder_.size() == compounds_.size()) return true;
+
+  vector<bool> ordered(compounds_.size(), false);
+  for (uint32_t i : compoundOrder_) ordered[i] = true;
+  for (uint32_t i = 0; i < compounds_.size(); ++i) {
+    if (!ordered[i]) {
+      cyclic_.push_back(PendulumHandle{PendulumHandle::kCompound, i});
+      compounds_[i].preferredBufferSize = 1;
+      compounds_[i].position = compounds_[i].center;
+    }
+  }
+  //their buffers still have to be sized, from what their children have
+  for (const auto& edge : children_) {
+    if (ordered[edge.first.index]) continue;
+    size_t& size = compounds_[edge.first.index].preferredBufferSize;
+    size = max(size, (*this)[edge.second].preferredBufferSize);
+  }
+  return false;
+}
+
+/*
+ * Kahn's algorithm over the compound -> compound edges (the simple pendulums
+ * have no children, so they are all done before any compound).  The
+ * compounds that are ready keep the order they were added in.
+ */
+void Scene::SortCompounds() {
+  size_t count = compounds_.size();
+  vector<uint32_t> waitingFor(count, 0);
+  //parents of compound i are parents[firstParent[i] .. firstParent[i + 1])
+  vector<uint32_t> firstParent(count + 1, 0);
+  for (const auto& edge : children_) {
+    if (edge.second.kind != PendulumHandle::kCompound) continue;
+    ++waitingFor[edge.first.index];
+    ++firstParent[edge.second.index + 1];
+  }
+  for (size_t i = 0; i < count; ++i) firstParent[i + 1] += firstParent[i];
+  vector<uint32_t> parents(firstParent[count]);
+  vector<uint32_t> next(firstParent.begin(), firstParent.end() - 1);
+  for (const auto& edge : children_) {
+    if (edge.second.kind != PendulumHandle::kCompound) continue;
+    parents[next[edge.second.index]++] = edge.first.index;
+  }
+
+  compoundOrder_.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    if (waitingFor[i] == 0) compoundOrder_.push_back(i);
+  }
+  //compoundOrder_ doubles as the queue
+  for (size_t done = 0; done < compoundOrder_.size(); ++done) {
+    uint32_t child = compoundOrder_[done];
+    for (uint32_t p = firstParent[child]; p < firstParent[child + 1]; ++p) {
+      if (--waitingFor[parents[p]] == 0) compoundOrder_.push_back(parents[p]);
+    }
+  }
+}
+
+void Scene::swap(Scene& other) {
+  simples_.swap(other.simples_);
+  compounds_.swap(other.compounds_);
+  order_.swap(other.order_);
+  children_.swap(other.children_);
+  compoundOrder_.swap(other.compoundOrder_);
+  cyclic_.swap(other.cyclic_);
+}
+
+//the compounds are made of the simple pendulums, so they go second
+void Scene::UpdatePositions() {
+  for (auto& pendulum : simples_) pendulum.UpdatePosition();
+  for (uint32_t i : compoundOrder_) compounds_[i].UpdatePosition();
+}
+
+PendulumBase& Scene::operator[](PendulumHandle handle) {
+  switch (handle.kind) {
+    case PendulumHandle::kSimple : return simples_[handle.index];
+    case PendulumHandle::kCompound : return compounds_[handle.index];
+    default : assert(false && "Scene::operator[]");
+      return simples_[handle.index];
+  }
+}
+
+const PendulumBase& Scene::operator[](PendulumHandle handle) const {
+  return const_cast<Scene&>(*this)[handle];
+}
@@ -0,0 +1,501 @@
+#include "scene_file.h"
+
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace pendulumNames;
+using namespace std;
+
+//reads back as something else on a machine with the other byte order
+const uint32_t kByteOrder = 0x01020304;
+
+struct SceneFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t stringsSize;
+  uint32_t simpleCount;
+  uint32_t compoundCount;
+  uint32_t orderCount;
+  uint32_t childCount;
+  uint32_t hashCount;
+  uint32_t sourceCount;
+  //in bytes, the line lengths are varints
+  uint32_t linesSize;
+  uint32_t locationCount;
+};
+
+//a string in the strings section
+struct StringRef {
+  uint32_t offset;
+  uint32_t size;
+};
+
+struct SimpleRecord {
+  Position center;
+  Color color;
+  double amplitude;
+  Direction direction;
+  Frequency frequency;
+  StringRef name;
+  uint32_t type;
+  uint32_t padding;
+};
+
+struct CompoundRecord {
+  Position center;
+  Color color;
+  double cycles;
+  StringRef name;
+};
+
+struct HashRecord {
+  StringRef name;
+  uint64_t hash;
+};
+
+//a source file, its lines are the next lineCount in the lines section
+struct SourceRecord {
+  StringRef name;
+  uint32_t lineCount;
+};
+
+//a range is in one file, source is an index into the sources section, or
+//kNoSource
+struct LocationRecord {
+  StringRef name;
+  uint32_t source;
+  uint32_t beginOffset;
+  uint32_t endOffset;
+};
+
+const uint32_t kNoSource = (uint32_t)-1;
+
+static_assert(is_trivially_copyable<SimpleRecord>::value &&
+              is_trivially_copyable<CompoundRecord>::value &&
+              is_trivially_copyable<HashRecord>::value &&
+              is_trivially_copyable<SourceRecord>::value &&
+              is_trivially_copyable<LocationRecord>::value &&
+              is_trivially_copyable<PendulumHandle>::value,
+              "scene file records are written and read as bytes");
+
+//the i-th record of a section, which may not be aligned
+template<typename T>
+T RecordAt(const char* section, size_t i) {
+  T record;
+  memcpy(&record, section + i*sizeof(T), sizeof(T));
+  return record;
+}
+
+/*
+ * map[key] = value, in constant time when the keys come in order (the hashes
+ * and locations are written sorted by name) and the map has nothing after.
+ */
+template<typename T>
+void AssignSorted(map<string, T>& m, string key, const T& value) {
+  m.emplace_hint(m.end(), move(key), value)->second = value;
+}
+
+uint64_t Align(uint64_t offset) { return (offset + 7) & ~(uint64_t)7; }
+
+//7 bits at a time, low bits first, the high bit set on all but the last byte
+void AppendVarint(string& out, uint64_t value) {
+  for (; value >= 0x80; value >>= 7) out += (char)(0x80 | (value & 0x7f));
+  out += (char)value;
+}
+
+//false if it runs past end, or doesn't fit in 64 bits
+bool ReadVarint(const char*& c, const char* end, uint64_t& value) {
+  value = 0;
+  for (unsigned shift = 0; c != end && shift < 64; shift += 7) {
+    uint8_t byte = *c++;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+//where each section starts, worked out from the header's counts
+struct SceneLayout {
+  explicit SceneLayout(const SceneFileHeader& header) {
+    strings = Align(sizeof(SceneFileHeader));
+    simples = Align(strings + header.stringsSize);
+    compounds = simples + header.simpleCount*(uint64_t)sizeof(SimpleRecord);
+    order = compounds +
+        header.compoundCount*(uint64_t)sizeof(CompoundRecord);
+    children = Align(order + header.orderCount);
+    hashes = children + 2*header.childCount*(uint64_t)sizeof(PendulumHandle);
+    sources = hashes + header.hashCount*(uint64_t)sizeof(HashRecord);
+    lines = sources + header.sourceCount*(uint64_t)sizeof(SourceRecord);
+    locations = Align(lines + header.linesSize);
+    end = locations + header.locationCount*(uint64_t)sizeof(LocationRecord);
+  }
+
+  uint64_t strings, simples, compounds, order, children, hashes, sources;
+  uint64_t lines, locations, end;
+};
+
+//
+
+bool pendulumNames::IsSceneFile(const char* begin, const char* end) {
+  return (size_t)(end - begin) >= sizeof(kSceneMagic) &&
+      memcmp(begin, kSceneMagic, sizeof(kSceneMagic)) == 0;
+}
+
+/*
+ * Kahn's algorithm over the file's (already checked) compound -> compound
+ * child records, as Scene::Link() does it: true if every compound can be
+ * ordered after its children, i.e. none of them is made of itself.
+ */
+bool Acyclic(const char* children, uint32_t childCount,
+    uint32_t compoundCount) {
+  vector<uint32_t> waitingFor(compoundCount, 0);
+  //parents of compound i are parents[firstParent[i] .. firstParent[i + 1])
+  vector<uint32_t> firstParent(compoundCount + 1, 0);
+  for (uint32_t i = 0; i < 2*childCount; i += 2) {
+    PendulumHandle child = RecordAt<PendulumHandle>(children, i + 1);
+    if (child.kind != PendulumHandle::kCompound) continue;
+    ++waitingFor[RecordAt<PendulumHandle>(children, i).index];
+    ++firstParent[child.index + 1];
+  }
+  for (uint32_t i = 0; i < compoundCount; ++i) {
+    firstParent[i + 1] += firstParent[i];
+  }
+  vector<uint32_t> parents(firstParent[compoundCount]);
+  vector<uint32_t> next(firstParent.begin(), firstParent.end() - 1);
+  for (uint32_t i = 0; i < 2*childCount; i += 2) {
+    PendulumHandle child = RecordAt<PendulumHandle>(children, i + 1);
+    if (child.kind != PendulumHandle::kCompound) continue;
+    parents[next[child.index]++] = RecordAt<PendulumHandle>(children, i).index;
+  }
+
+  vector<uint32_t> ordered;
+  for (uint32_t i = 0; i < compoundCount; ++i) {
+    if (waitingFor[i] == 0) ordered.push_back(i);
+  }
+  for (size_t done = 0; done < ordered.size(); ++done) {
+    uint32_t child = ordered[done];
+    for (uint32_t p = firstParent[child]; p < firstParent[child + 1]; ++p) {
+      if (--waitingFor[parents[p]] == 0) ordered.push_back(parents[p]);
+    }
+  }
+  return ordered.size() == compoundCount;
+}
+
+/*
+ * Everything is checked before anything is added to the scene, so that a bad
+ * file adds nothing.
+ */
+bool pendulumNames::ReadSceneFile(const char* begin, const char* end,
+    Scene& scene, double timeDelta, map<string, uint64_t>& blockHashes,
+    map<string, Range>* locationMap) {
+  if (!IsSceneFile(begin, end)) return false;
+  size_t size = end - begin;
+  SceneFileHeader header;
+  if (size < sizeof(header)) return false;
+  memcpy(&header, begin, sizeof(header));
+  if (header.version != kSceneVersion || header.byteOrder != kByteOrder) {
+    return false;
+  }
+  SceneLayout layout(header);
+  if (layout.end > size) return false;
+
+  const char* strings = begin + layout.strings;
+  auto validString = [&](const StringRef& ref) {
+    return ref.offset <= header.stringsSize &&
+        ref.size <= header.stringsSize - ref.offset;
+  };
+  auto stringAt = [&](const StringRef& ref) {
+    return string(strings + ref.offset, ref.size);
+  };
+  const char* simples = begin + layout.simples;
+  const char* compounds = begin + layout.compounds;
+  const char* order = begin + layout.order;
+  const char* children = begin + layout.children;
+  const char* hashes = begin + layout.hashes;
+  const char* sources = begin + layout.sources;
+  const char* lines = begin + layout.lines;
+  const char* locations = begin + layout.locations;
+
+  for (uint32_t i = 0; i < header.simpleCount; ++i) {
+    SimpleRecord record = RecordAt<SimpleRecord>(simples, i);
+    if (!validString(record.name) ||
+        record.type >= SimplePendulum::kInvalid) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < header.compoundCount; ++i) {
+    if (!validString(RecordAt<CompoundRecord>(compounds, i).name)) {
+      return false;
+    }
+  }
+  //the order is only the kinds, each kind's records are taken in turn
+  uint32_t simpleCount = 0, compoundCount = 0;
+  for (uint32_t i = 0; i < header.orderCount; ++i) {
+    switch ((uint8_t)order[i]) {
+      case PendulumHandle::kSimple : ++simpleCount; break;
+      case PendulumHandle::kCompound : ++compoundCount; break;
+      default : return false;
+    }
+  }
+  if (simpleCount != header.simpleCount ||
+      compoundCount != header.compoundCount) {
+    return false;
+  }
+  auto validHandle = [&](PendulumHandle handle) {
+    return (handle.kind == PendulumHandle::kSimple &&
+            handle.index < header.simpleCount) ||
+           (handle.kind == PendulumHandle::kCompound &&
+            handle.index < header.compoundCount);
+  };
+  for (uint32_t i = 0; i < 2*header.childCount; i += 2) {
+    PendulumHandle compound = RecordAt<PendulumHandle>(children, i);
+    if (compound.kind != PendulumHandle::kCompound || !validHandle(compound) ||
+        !validHandle(RecordAt<PendulumHandle>(children, i + 1))) {
+      return false;
+    }
+  }
+  if (!Acyclic(children, header.childCount, header.compoundCount)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header.hashCount; ++i) {
+    if (!validString(RecordAt<HashRecord>(hashes, i).name)) return false;
+  }
+  uint32_t sourceCount = locationMap ? header.sourceCount : 0;
+  uint32_t locationCount = locationMap ? header.locationCount : 0;
+  //every source's line starts, one after the other, from the lengths
+  vector<size_t> lineStarts;
+  const char* line = lines;
+  const char* linesEnd = lines + header.linesSize;
+  for (uint32_t i = 0; i < sourceCount; ++i) {
+    SourceRecord record = RecordAt<SourceRecord>(sources, i);
+    if (!validString(record.name)) return false;
+    size_t start = 0;
+    for (uint32_t l = 0; l < record.lineCount; ++l) {
+      uint64_t length;
+      if (!ReadVarint(line, linesEnd, length)) return false;
+      start += length;
+      lineStarts.push_back(start);
+    }
+  }
+  if (line != linesEnd && sourceCount > 0) return false;
+  for (uint32_t i = 0; i < locationCount; ++i) {
+    LocationRecord record = RecordAt<LocationRecord>(locations, i);
+    if (!validString(record.name) ||
+        (record.source >= sourceCount && record.source != kNoSource)) {
+      return false;
+    }
+  }
+
+  //the file's handles to the scene's
+  vector<PendulumHandle> simpleHandles(header.simpleCount);
+  vector<PendulumHandle> compoundHandles(header.compoundCount);
+  scene.Reserve(header.simpleCount, header.compoundCount);
+  simpleCount = compoundCount = 0;
+  for (uint32_t i = 0; i < header.orderCount; ++i) {
+    PendulumHandle handle{(PendulumHandle::Kind)(uint8_t)order[i], 0};
+    handle.index = (handle.kind == PendulumHandle::kSimple) ?
+        simpleCount++ : compoundCount++;
+    if (handle.kind == PendulumHandle::kSimple) {
+      SimpleRecord record = RecordAt<SimpleRecord>(simples, handle.index);
+      SimplePendulum pendulum;
+      pendulum.center = record.center;
+      pendulum.color = record.color;
+      pendulum.amplitude = record.amplitude;
+      pendulum.direction = record.direction;
+      pendulum.frequency = record.frequency;
+      pendulum.type = (SimplePendulum::Type)record.type;
+      pendulum.name = stringAt(record.name);
+      pendulum.SetPreferredBufferSize(timeDelta);
+      simpleHandles[handle.index] = scene.Add(move(pendulum));
+    } else {
+      CompoundRecord record =
+        RecordAt<CompoundRecord>(compounds, handle.index);
+      CompoundPendulum compound;
+      compound.center = record.center;
+      compound.color = record.color;
+      compound.cycles_ = record.cycles;
+      compound.name = stringAt(record.name);
+      compoundHandles[handle.index] = scene.Add(move(compound));
+    }
+  }
+  auto sceneHandle = [&](PendulumHandle handle) {
+    return (handle.kind == PendulumHandle::kSimple) ?
+        simpleHandles[handle.index] : compoundHandles[handle.index];
+  };
+  for (uint32_t i = 0; i < 2*header.childCount; i += 2) {
+    scene.AddChild(sceneHandle(RecordAt<PendulumHandle>(children, i)),
+        sceneHandle(RecordAt<PendulumHandle>(children, i + 1)));
+  }
+  for (uint32_t i = 0; i < header.hashCount; ++i) {
+    HashRecord record = RecordAt<HashRecord>(hashes, i);
+    AssignSorted(blockHashes, stringAt(record.name), record.hash);
+  }
+  //the lines as they were when the file was compiled, which the offsets are in
+  vector<FileId> files(sourceCount);
+  auto firstLine = lineStarts.begin();
+  for (uint32_t i = 0; i < sourceCount; ++i) {
+    SourceRecord record = RecordAt<SourceRecord>(sources, i);
+    files[i] = Sources().Register(stringAt(record.name));
+    Sources().SetLineStarts(files[i],
+        vector<size_t>(firstLine, firstLine + record.lineCount));
+    firstLine += record.lineCount;
+  }
+  for (uint32_t i = 0; i < locationCount; ++i) {
+    LocationRecord record = RecordAt<LocationRecord>(locations, i);
+    FileId file = (record.source == kNoSource) ? kNoFile : files[record.source];
+    AssignSorted(*locationMap, stringAt(record.name), Range{
+        Location{file, record.beginOffset}, Location{file, record.endOffset}});
+  }
+  return true;
+}
+
+//
+
+//the strings section, with every distinct string stored once
+class StringTable {
+ public:
+  StringRef Add(const string& s) {
+    auto it = refs_.find(s);
+    if (it != refs_.end()) return it->second;
+    StringRef ref{(uint32_t)data_.size(), (uint32_t)s.size()};
+    data_ += s;
+    refs_[s] = ref;
+    return ref;
+  }
+
+  const string& data() const { return data_; }
+
+ private:
+  string data_;
+  map<string, StringRef> refs_;
+};
+
+template<typename T>
+void WriteRecords(ofstream& out, const vector<T>& records) {
+  if (records.empty()) return;
+  out.write(reinterpret_cast<const char*>(&records[0]),
+      records.size()*sizeof(T));
+}
+
+void WritePadding(ofstream& out, uint64_t from, uint64_t to) {
+  const char zeros[8] = {};
+  out.write(zeros, to - from);
+}
+
+bool pendulumNames::WriteSceneFile(const string& fileName, const Scene& scene,
+    const map<string, uint64_t>& blockHashes,
+    const map<string, Range>* locationMap) {
+  StringTable strings;
+  vector<SimpleRecord> simples;
+  vector<CompoundRecord> compounds;
+  for (PendulumHandle handle : scene.Handles()) {
+    if (handle.kind == PendulumHandle::kSimple) {
+      const SimplePendulum& pendulum =
+        static_cast<const SimplePendulum&>(scene[handle]);
+      SimpleRecord record;
+      memset(&record, 0, sizeof(record));
+      record.center = pendulum.center;
+      record.color = pendulum.color;
+      record.amplitude = pendulum.amplitude;
+      record.direction = pendulum.direction;
+      record.frequency = pendulum.frequency;
+      record.name = strings.Add(pendulum.name);
+      record.type = pendulum.type;
+      simples.push_back(record);
+    } else {
+      const CompoundPendulum& compound =
+        static_cast<const CompoundPendulum&>(scene[handle]);
+      CompoundRecord record;
+      memset(&record, 0, sizeof(record));
+      record.center = compound.center;
+      record.color = compound.color;
+      record.cycles = compound.cycles_;
+      record.name = strings.Add(compound.name);
+      compounds.push_back(record);
+    }
+  }
+  vector<PendulumHandle> children;
+  for (const auto& edge : scene.Children()) {
+    children.push_back(edge.first);
+    children.push_back(edge.second);
+  }
+  vector<HashRecord> hashes;
+  for (const auto& p : blockHashes) {
+    hashes.push_back(HashRecord{strings.Add(p.first), p.second});
+  }
+  //only the kinds, the indices are in order
+  string order;
+  for (PendulumHandle handle : scene.Handles()) order += (char)handle.kind;
+  vector<SourceRecord> sources;
+  //each line's length, the one before it is where it starts
+  string lines;
+  //FileIds to indices into sources
+  map<FileId, uint32_t> sourceIndices;
+  auto sourceOf = [&](FileId file) {
+    if (file == kNoFile) return kNoSource;
+    auto index = sourceIndices.find(file);
+    if (index != sourceIndices.end()) return index->second;
+    vector<size_t> lineStarts = Sources().LineStarts(file);
+    sources.push_back(SourceRecord{strings.Add(Sources().FileName(file)),
+        (uint32_t)lineStarts.size()});
+    size_t previous = 0;
+    for (size_t start : lineStarts) {
+      AppendVarint(lines, start - previous);
+      previous = start;
+    }
+    return sourceIndices[file] = sources.size() - 1;
+  };
+  vector<LocationRecord> locations;
+  if (locationMap) {
+    for (const auto& p : *locationMap) {
+      const Range& range = p.second;
+      //the offsets are 32 bits, as the string offsets are
+      if (range.begin.offset > UINT32_MAX || range.end.offset > UINT32_MAX) {
+        return false;
+      }
+      locations.push_back(LocationRecord{strings.Add(p.first),
+          sourceOf(range.begin.file), (uint32_t)range.begin.offset,
+          (uint32_t)range.end.offset});
+    }
+  }
+
+  SceneFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kSceneMagic, sizeof(kSceneMagic));
+  header.version = kSceneVersion;
+  header.byteOrder = kByteOrder;
+  header.stringsSize = strings.data().size();
+  header.simpleCount = simples.size();
+  header.compoundCount = compounds.size();
+  header.orderCount = scene.Handles().size();
+  header.childCount = scene.Children().size();
+  header.hashCount = hashes.size();
+  header.sourceCount = sources.size();
+  header.linesSize = lines.size();
+  header.locationCount = locations.size();
+  SceneLayout layout(header);
+
+  ofstream out(fileName, ios::binary | ios::trunc);
+  if (!out) return false;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WritePadding(out, sizeof(header), layout.strings);
+  out.write(strings.data().data(), strings.data().size());
+  WritePadding(out, layout.strings + header.stringsSize, layout.simples);
+  WriteRecords(out, simples);
+  WriteRecords(out, compounds);
+  out.write(order.data(), order.size());
+  WritePadding(out, layout.order + order.size(), layout.children);
+  WriteRecords(out, children);
+  WriteRecords(out, hashes);
+  WriteRecords(out, sources);
+  out.write(lines.data(), lines.size());
+  WritePadding(out, layout.lines + lines.size(), layout.locations);
+  WriteRecords(out, locations);
+  out.close();
+  return !out.fail();
+}
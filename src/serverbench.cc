@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "location.h"
+#include "pendulum.h"
+#include "pendulum_parser.h"
+#include "scene.h"
+#include "vimserver.h"
+
+using namespace pendulumNames;
+using namespace vimserverNames;
+using namespace std;
+
+double PendulumBase::timeDelta = .01;
+
+/*
+ * Editor latency benchmark.  Starts an editor through a VimServer (the
+ * mockeditor by default, so that it runs anywhere without a display and
+ * without anyone at the keyboard), and times each of its calls over and over,
+ * reporting the median, the 99th percentile and the worst, in microseconds.
+ *
+ * The cursor is moved to the start of every pendulum in the examples in turn,
+ * and highlights go on and off for their ranges.  SetCursor() and the
+ * unhighlights don't wait for the editor, so they are also timed followed by
+ * a GetCursor(), which has to wait until the editor has done them, and which
+ * is checked to have landed where it was sent.
+ *
+ * usage: serverbench [samples] [editor]
+ *
+ * Run from the top of the tree, for examples/ and elf/mockeditor (make
+ * mockeditor serverbench).  The VimServer talks a lot on cout, which is sent
+ * nowhere while timing.  Returns 1 if any call fails or the cursor ends up
+ * anywhere else, 2 for bad arguments or if the editor can't be started.
+ */
+
+const list<string> kFileNames {"examples/input", "examples/input2"};
+
+//in microseconds, sorted
+struct Latencies {
+  string name;
+  vector<double> samples;
+  size_t failures = 0;
+
+  double Percentile(double p) const {
+    if (samples.empty()) return 0;
+    size_t i = static_cast<size_t>(p/100*samples.size());
+    return samples[min(i, samples.size() - 1)];
+  }
+};
+
+//f is called samples times, with 0, 1, 2...; false is a failure.  before
+//isn't timed.
+Latencies Measure(const string& name, size_t samples,
+    const function<bool(size_t)>& f,
+    const function<void(size_t)>& before = nullptr) {
+  Latencies latencies;
+  latencies.name = name;
+  latencies.samples.reserve(samples);
+  for (size_t i = 0; i < samples; ++i) {
+    if (before) before(i);
+    auto begin = chrono::steady_clock::now();
+    bool ok = f(i);
+    auto end = chrono::steady_clock::now();
+    latencies.samples.push_back(
+        chrono::duration<double, micro>(end - begin).count());
+    if (!ok) ++latencies.failures;
+  }
+  sort(latencies.samples.begin(), latencies.samples.end());
+  return latencies;
+}
+
+void Report(const Latencies& latencies) {
+  cout << setw(28) << left << latencies.name << right << fixed
+       << setprecision(1)
+       << setw(10) << latencies.Percentile(50)
+       << setw(10) << latencies.Percentile(99)
+       << setw(10) << latencies.samples.back();
+  if (latencies.failures) cout << "  FAILED " << latencies.failures;
+  cout << endl;
+}
+
+//a million already takes minutes, and an overflowing count won't fit in memory
+const size_t kMaxSamples = 1000000;
+
+int main(int argc, char** argv) {
+  const string usage = "usage: serverbench [samples] [editor]";
+  size_t samples = 2000;
+  if (argc > 1) {
+    //digits only, as strtoul would take "-1" (or nothing at all)
+    char* samplesEnd;
+    samples = strtoul(argv[1], &samplesEnd, 10);
+    if (!isdigit((unsigned char)argv[1][0]) || *samplesEnd != '\0' ||
+        samples == 0 || samples > kMaxSamples) {
+      cout << "bad sample count: " << argv[1] << endl << usage << endl;
+      return 2;
+    }
+  }
+  string editor = (argc > 2) ? argv[2] : "elf/mockeditor";
+
+  streambuf* coutBuffer = cout.rdbuf();
+  ostringstream discard;
+  cout.rdbuf(discard.rdbuf());
+
+  Scene scene;
+  HarmonogramParser parser;
+  parser.Parse(kFileNames, scene);
+  vector<Range> ranges;
+  for (const auto& p : parser.locationMap) ranges.push_back(p.second);
+  set<Range> all(ranges.begin(), ranges.end()), half;
+  for (size_t i = 0; i < ranges.size(); i += 2) half.insert(ranges[i]);
+
+  VimServer server("serverbench", editor);
+  server.SetFileNameList(kFileNames);
+  if (ranges.empty() || !server.Activate()) {
+    cout.rdbuf(coutBuffer);
+    cout << "serverbench: couldn't start: " << editor << endl;
+    return 2;
+  }
+  //as harmonogram does once it knows the editor is in normal mode
+  server.setNormal = true;
+
+  auto cursorAt = [&](const Location& location) {
+    Location cursor;
+    return server.GetCursor(cursor) && cursor == location;
+  };
+
+  vector<Latencies> results;
+  results.push_back(Measure("GetCursor", samples, [&](size_t) {
+      Location cursor;
+      return server.GetCursor(cursor);
+    }));
+  results.push_back(Measure("SetCursor", samples, [&](size_t i) {
+      return server.SetCursor(ranges[i % ranges.size()].begin);
+    }));
+  results.push_back(Measure("SetCursor + GetCursor", samples, [&](size_t i) {
+      const Location& location = ranges[i % ranges.size()].begin;
+      return server.SetCursor(location) && cursorAt(location);
+    }));
+  //one highlight at a time
+  auto range = [&](size_t i) -> const Range& {
+    return ranges[i % ranges.size()];
+  };
+  results.push_back(Measure("HighlightRange", samples, [&](size_t i) {
+      return server.HighlightRange(range(i));
+    }, [&](size_t) { server.SetHighlightedRanges({}); }));
+  results.push_back(Measure("UnHighlightRange", samples, [&](size_t i) {
+      return server.UnHighlightRange(range(i));
+    }, [&](size_t i) { server.HighlightRange(range(i)); }));
+  results.push_back(Measure("UnHighlightRange + GetCursor", samples,
+      [&](size_t i) {
+        Location cursor;
+        return server.UnHighlightRange(range(i)) && server.GetCursor(cursor);
+      }, [&](size_t i) { server.HighlightRange(range(i)); }));
+  results.push_back(Measure("SetHighlightedRanges", samples, [&](size_t i) {
+      //every other one added or deleted, all in one go
+      return server.SetHighlightedRanges((i % 2) ? half : all);
+    }));
+  server.SetHighlightedRanges({});
+  server.Exit();
+
+  cout.rdbuf(coutBuffer);
+  cout << "editor: " << editor << ", " << samples << " samples, "
+       << ranges.size() << " ranges" << endl;
+  cout << setw(28) << left << "microseconds" << right << setw(10) << "p50"
+       << setw(10) << "p99" << setw(10) << "max" << endl;
+  bool ok = true;
+  for (const Latencies& latencies : results) {
+    Report(latencies);
+    ok = ok && latencies.failures == 0;
+  }
+  return ok ? 0 : 1;
+}
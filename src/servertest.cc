@@ -9,6 +9,8 @@ using namespace std;
 using namespace pendulumNames;
 using namespace vimserverNames;
 
+double PendulumBase::timeDelta = .01;
+
 void WaitForInput(const string& message) {
   static char c;
   cout << message << '\n' << "Enter any key to continue" << endl;
@@ -23,28 +25,56 @@ list<string> FileNames() {
   return fileNames;
 }
 
-list<PendulumPtr> pendulums;
-VimServer vimserver("FOO");
+Scene pendulums;
+VimServer* vimserver;
 bool response;
 HarmonogramParser parser;
+size_t failures = 0;
+
+//prints the response to a call that should have worked
+void Check(const string& call) {
+  cout << call << ": " << response << endl;
+  if (!response) {
+    cout << "FAILED: " << call << endl;
+    ++failures;
+  }
+}
 
 void HighlightTest() {
   WaitForInput("Highlight Pendulums");
-  for (const auto& pPtr : pendulums) {
-    cout << "pPtr: " << pPtr->name;
+  for (PendulumHandle handle : pendulums.Handles()) {
+    cout << "pendulum: " << pendulums[handle].name;
     WaitForInput("HighlightPattern");
-    response = vimserver.HighlightPattern(pPtr->name);
-    cout << "HighlightPattern: " << response << endl;
+    response = vimserver->HighlightPattern(pendulums[handle].name);
+    Check("HighlightPattern");
   }
 }
 
 void UnHighlightTest() {
   WaitForInput("UnHighlight Pendulums");
-  for (const auto& pPtr : pendulums) {
-    cout << "pPtr: " << pPtr->name;
+  for (PendulumHandle handle : pendulums.Handles()) {
+    cout << "pendulum: " << pendulums[handle].name;
     WaitForInput("UnHighlightPattern");
-    response = vimserver.UnHighlightPattern(pPtr->name);
-    cout << "UnHighlightPattern: " << response << endl;
+    response = vimserver->UnHighlightPattern(pendulums[handle].name);
+    Check("UnHighlightPattern");
+  }
+}
+
+//all of them, then every other one, then none: each step is one round trip
+void SetHighlightedRangesTest() {
+  WaitForInput("Set Highlighted Ranges");
+  set<Range> ranges;
+  for (const auto& p : parser.locationMap) ranges.insert(p.second);
+  for (size_t step = 0; step < 3; ++step) {
+    WaitForInput("SetHighlightedRanges: " + to_string(ranges.size()));
+    response = vimserver->SetHighlightedRanges(ranges);
+    Check("SetHighlightedRanges");
+    bool keep = false;
+    for (auto range = ranges.begin(); range != ranges.end();) {
+      keep = !keep;
+      if (step == 0 && keep) ++range;
+      else range = ranges.erase(range);
+    }
   }
 }
 
@@ -52,31 +82,45 @@ void SetCursorTest() {
   WaitForInput("Set Cursor");
   for (const auto& p : parser.locationMap) {
     WaitForInput("SetCursor: " + p.second.begin.ToString());
-    response = vimserver.SetCursor(p.second.begin);
-    cout << "SetCursor: " << response << endl;
+    response = vimserver->SetCursor(p.second.begin);
+    Check("SetCursor");
   }
 }
 
 void Exit() {
-  WaitForInput("Exit"); response = vimserver.Exit(); 
-  cout << "Exit: " << response << endl;
+  WaitForInput("Exit"); response = vimserver->Exit(); 
+  Check("Exit");
 }
 
-void CheckServer() {
-  WaitForInput("CheckServer"); response = vimserver.CheckServer(); 
-  cout << "CheckServer: " << response << endl;
+//whether the editor should be there
+void CheckServer(bool expected) {
+  WaitForInput("CheckServer"); response = vimserver->CheckServer() == expected;
+  Check(expected ? "CheckServer" : "CheckServer, after Exit");
 }
 
 void Activate() {
-  WaitForInput("Activate"); response = vimserver.Activate(); 
-  cout << "Activate: " << response << endl;
+  WaitForInput("Activate"); response = vimserver->Activate(); 
+  Check("Activate");
 }
 
-int main() {
+/*
+ * Goes through the VimServer's calls one at a time, waiting for a key in
+ * between, so that what happens in the editor can be watched.  Returns 1 if
+ * any of them fails.  The editor is
+ * gvim unless another command is given, e.g. the stand in, which can be run
+ * through without stopping:
+ *
+ * yes | elf/servertest elf/mockeditor
+ *
+ * serverbench times the same calls without stopping.
+ */
+int main(int argc, char** argv) {
+  VimServer server("FOO", (argc > 1) ? argv[1] : "");
+  vimserver = &server;
   list<string> fileNames = FileNames();
-  vimserver.SetFileNameList(fileNames);
-  pendulums = parser.Parse(fileNames);
-  //for (auto&& pPtr : pendulums) cout << pPtr->ToString() << endl;
+  vimserver->SetFileNameList(fileNames);
+  parser.Parse(fileNames, pendulums);
+  //for (auto h : pendulums.Handles()) cout << pendulums[h].ToString() << endl;
 
   
   for (auto p : parser.locationMap) cout << p.first << 
@@ -85,15 +129,15 @@ int main() {
   cout << boolalpha;
   Activate();
   Activate();
-  CheckServer();
-  Exit();
-  CheckServer();
+  CheckServer(true);
 
   HighlightTest();
-  Exit();
   UnHighlightTest();
-  Exit();
+  SetHighlightedRangesTest();
   SetCursorTest();
 
- 
+  Exit();
+  CheckServer(false);
+  cout << (failures ? "FAILED" : "ok") << endl;
+  return failures ? 1 : 0;
 }
@@ -0,0 +1,149 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+using namespace pendulumNames;
+using namespace std;
+
+uint64_t CellKey(int64_t cx, int64_t cy) {
+  return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+}
+
+PointGrid::PointGrid(double cellSize) : cellSize_(cellSize) {
+  assert(cellSize > 0);
+}
+
+//the buckets are emptied, not freed, since the same cells are likely refilled
+void PointGrid::Clear() {
+  for (auto& cell : cells_) cell.second.clear();
+  positions_.clear();
+}
+
+void PointGrid::Insert(size_t id, const Position& position) {
+  if (id >= positions_.size()) positions_.resize(id + 1);
+  positions_[id] = position;
+  cells_[Key(position)].push_back(id);
+}
+
+void PointGrid::Move(size_t id, const Position& position) {
+  assert(id < positions_.size());
+  uint64_t oldKey = Key(positions_[id]);
+  uint64_t newKey = Key(position);
+  positions_[id] = position;
+  if (oldKey == newKey) return;
+  vector<size_t>& oldCell = cells_[oldKey];
+  auto it = find(oldCell.begin(), oldCell.end(), id);
+  assert(it != oldCell.end());
+  *it = oldCell.back();
+  oldCell.pop_back();
+  cells_[newKey].push_back(id);
+}
+
+size_t PointGrid::Nearest(const Position& position, double tolerance) const {
+  assert(tolerance <= cellSize_);
+  int64_t cx = Cell(position.x);
+  int64_t cy = Cell(position.y);
+  size_t nearest = kNone;
+  double nearestDistance = tolerance;
+  for (int64_t x = cx - 1; x <= cx + 1; ++x) {
+    for (int64_t y = cy - 1; y <= cy + 1; ++y) {
+      auto cell = cells_.find(Key(x, y));
+      if (cell == cells_.end()) continue;
+      for (size_t id : cell->second) {
+        double distance = Norm(positions_[id] - position);
+        if (distance < nearestDistance) {
+          nearest = id;
+          nearestDistance = distance;
+        }
+      }
+    }
+  }
+  return nearest;
+}
+
+int64_t PointGrid::Cell(double coordinate) const {
+  return (int64_t)floor(coordinate/cellSize_);
+}
+
+uint64_t PointGrid::Key(const Position& position) const {
+  return Key(Cell(position.x), Cell(position.y));
+}
+
+uint64_t PointGrid::Key(int64_t cx, int64_t cy) const { return CellKey(cx, cy); }
+
+//
+
+double SegmentDistance(const Position& p, const Position& a, const Position& b) {
+  Position ab = b - a;
+  Position ap = p - a;
+  double lengthSquared = ab.x*ab.x + ab.y*ab.y;
+  double t = lengthSquared > 0 ? (ap.x*ab.x + ap.y*ab.y)/lengthSquared : 0;
+  t = min(max(t, 0.), 1.);
+  return Norm(ap - Position{t*ab.x, t*ab.y});
+}
+
+SegmentGrid::SegmentGrid(double cellSize) : cellSize_(cellSize) {
+  assert(cellSize > 0);
+}
+
+void SegmentGrid::Clear() {
+  for (auto& cell : cells_) cell.second.clear();
+}
+
+int64_t SegmentGrid::Cell(double coordinate) const {
+  return (int64_t)floor(coordinate/cellSize_);
+}
+
+template<typename F>
+void SegmentGrid::ForEachCell(const Position& a, const Position& b, F f) {
+  int64_t x0 = Cell(min(a.x, b.x)), x1 = Cell(max(a.x, b.x));
+  int64_t y0 = Cell(min(a.y, b.y)), y1 = Cell(max(a.y, b.y));
+  for (int64_t x = x0; x <= x1; ++x) {
+    for (int64_t y = y0; y <= y1; ++y) f(cells_[CellKey(x, y)]);
+  }
+}
+
+void SegmentGrid::Insert(size_t owner, uint32_t seq,
+    const Position& a, const Position& b) {
+  Segment segment{(uint32_t)owner, seq, (float)a.x, (float)a.y,
+                  (float)b.x, (float)b.y};
+  ForEachCell(a, b, [&](vector<Segment>& cell) { cell.push_back(segment); });
+}
+
+void SegmentGrid::Remove(size_t owner, uint32_t seq,
+    const Position& a, const Position& b) {
+  ForEachCell(a, b, [&](vector<Segment>& cell) {
+    for (auto it = cell.begin(); it != cell.end(); ++it) {
+      if (it->owner == owner && it->seq == seq) {
+        *it = cell.back();
+        cell.pop_back();
+        return;
+      }
+    }
+  });
+}
+
+size_t SegmentGrid::Nearest(const Position& position, double tolerance) const {
+  int64_t x0 = Cell(position.x - tolerance), x1 = Cell(position.x + tolerance);
+  int64_t y0 = Cell(position.y - tolerance), y1 = Cell(position.y + tolerance);
+  size_t nearest = kNone;
+  double nearestDistance = tolerance;
+  for (int64_t x = x0; x <= x1; ++x) {
+    for (int64_t y = y0; y <= y1; ++y) {
+      auto cell = cells_.find(CellKey(x, y));
+      if (cell == cells_.end()) continue;
+      for (const Segment& s : cell->second) {
+        double distance = SegmentDistance(position,
+            Position{s.ax, s.ay}, Position{s.bx, s.by});
+        if (distance < nearestDistance) {
+          nearest = s.owner;
+          nearestDistance = distance;
+        }
+      }
+    }
+  }
+  return nearest;
+}
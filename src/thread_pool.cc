@@ -0,0 +1,41 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threadCount) : stopping_(false) {
+  if (threadCount == 0) {
+    threadCount = max<size_t>(1, thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threadCount; ++i) {
+    threads_.emplace_back(&ThreadPool::Work, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto& t : threads_) t.join();
+}
+
+void ThreadPool::Work() {
+  while (true) {
+    function<void()> task;
+    {
+      unique_lock<mutex> lock(mutex_);
+      wake_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) return;
+      task = move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
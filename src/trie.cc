@@ -5,19 +5,21 @@
 #include <cctype>
 #include <iostream>
 #include <istream>
+#include <limits>
 #include <list>
 #include <string>
+#include <vector>
 
 using namespace std;
 
 class TrieNode {
  public:
   TrieNode() : c_(0xFF), parent_(nullptr), fallback_(this),
-      isToken(false), id_(++id) {}
+      isToken(false), tokenId_(0), id_(++id) {}
 
   TrieNode(char c, TrieNode* fallback, TrieNode* parent) : 
       c_(tolower(c)), parent_(parent), fallback_(fallback),
-      isToken(false), id_(++id) {}
+      isToken(false), tokenId_(0), id_(++id) {}
 
   friend Trie;
 
@@ -62,6 +64,7 @@ class TrieNode {
   TrieNode* parent_;
   TrieNode* fallback_;
   bool isToken;
+  int tokenId_;
   size_t id_;
   list<TrieNode> childList_;
 
@@ -70,6 +73,9 @@ class TrieNode {
 
 size_t TrieNode::id = 0;
 
+const TokenDfa::State TokenDfa::kStart;
+const int TokenDfa::kNoToken;
+
 Trie::Trie() : root_(make_unique<TrieNode>()) {
   Reset();
 }
@@ -82,7 +88,7 @@ void Trie::Insert(const list<string>& tokens) {
   }
 }
 
-void Trie::Insert(const string& branch) {
+void Trie::Insert(const string& branch, int tokenId) {
   //cout << "inserting: " << branch << endl;
   TrieNode* cur = root_.get();
   for (auto c : branch) {
@@ -100,6 +106,60 @@ void Trie::Insert(const string& branch) {
     }
   }
   cur->isToken = true;
+  cur->tokenId_ = tokenId;
+}
+
+/*
+ * The states are the nodes, numbered breadth first (so the root is
+ * TokenDfa::kStart).  The fallbacks are worked out again here, as in
+ * Aho-Corasick: a node falls back to the longest proper suffix of its prefix
+ * that is also in the Trie, and every byte without a child goes where the
+ * fallback would go.  A node accepts its own token, or else whatever its
+ * fallback accepts.
+ */
+TokenDfa Trie::Compile() const {
+  vector<const TrieNode*> nodes{root_.get()};
+  vector<size_t> depth{0};
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    for (const auto& child : nodes[i]->childList_) {
+      nodes.push_back(&child);
+      depth.push_back(depth[i] + 1);
+    }
+  }
+  assert(nodes.size() <= (size_t)numeric_limits<TokenDfa::State>::max() + 1);
+
+  TokenDfa dfa;
+  dfa.next_.assign(nodes.size()*256, TokenDfa::kStart);
+  dfa.accept_.assign(nodes.size(), TokenDfa::kNoToken);
+  dfa.length_.assign(nodes.size(), 0);
+  vector<TokenDfa::State> fallback(nodes.size(), TokenDfa::kStart);
+  TokenDfa::State* next = dfa.next_.data();
+
+  //the children of node i are numbered from firstChild on
+  TokenDfa::State firstChild = 1;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    TokenDfa::State* row = next + i*256;
+    const TokenDfa::State* fallbackRow = next + fallback[i]*256;
+    for (size_t c = 0; c < 256; ++c) row[c] = (i == 0) ? 0 : fallbackRow[c];
+    TokenDfa::State child = firstChild;
+    for (const auto& node : nodes[i]->childList_) {
+      unsigned char lower = node.c_;
+      fallback[child] = (i == 0) ? TokenDfa::kStart : fallbackRow[lower];
+      row[lower] = child;
+      row[toupper(lower)] = child;
+      ++child;
+    }
+    firstChild = child;
+
+    if (nodes[i]->isToken) {
+      dfa.accept_[i] = nodes[i]->tokenId_;
+      dfa.length_[i] = depth[i];
+    } else if (i != 0) {
+      dfa.accept_[i] = dfa.accept_[fallback[i]];
+      dfa.length_[i] = dfa.length_[fallback[i]];
+    }
+  }
+  return dfa;
 }
 
 string Trie::GetToken() {
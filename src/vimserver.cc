@@ -1,15 +1,17 @@
 #include "vimserver.h"
+#include <unistd.h>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <list>
+#include <set>
 
 using namespace std;
 
 namespace vimserverNames {
 
 const string kColorScheme = ":colorscheme desert";
-const string kEnter = "<Enter>";
 const string kReverseHighlightGroup = ":highlight reverse \
                                   gui=reverse cterm=reverse term=reverse";
 const string kRegL = "\"l\", \":lnext\", \"l\")";
@@ -18,7 +20,8 @@ const string kSet = ":set ";
 const string kSetReg = ":call setreg(";
 const string kWindowSize = "lines=20 columns=85";
 
-size_t VimServer::fileId = 0;
+//gvim can take a while to come up the first time
+const double kStartupTimeout = 10;
 
 template<typename T>
 list<string> MakeStringList(const list<T>& tList) {
@@ -35,95 +38,29 @@ string JoinList(const list<string>& stringList, char joiner = ' ') {
   return str;
 }
 
-/*
- * These are a bunch of string functions to simplify the creation of commands to
- * be communicated at the server
- */
-string ExprPrefix(const string& serverName) {
-  return "gvim --servername " + serverName + " --remote-expr ";
-}
-
-string SendPrefix(const string& serverName) {
-  return "gvim --servername " + serverName + " --remote-send ";
-}
-
-string QuoteDelim(char delim) { return (string)"\"" + delim + "\""; }
-string SingleQuote(const string& str) { return "'" + str + "'"; }
-
-string GetColCommand(const string& serverName, char delim = '>') {
-  return ExprPrefix(serverName) + 
-    SingleQuote("col(\".\") . " + QuoteDelim(delim));
-}
-
-string GetExitCommand(const string& serverName, char delim = '>') {
-  return SendPrefix(serverName) + 
-    SingleQuote(":xa" + kEnter);
-}
-
-string GetEditFileCommand(const string& serverName, const string& fileName,
-    char delim = '>') {
-  return SendPrefix(serverName) + 
-    SingleQuote(":edit " + fileName + kEnter);
-}
+//the whole cursor in one go, [line, column, file name]
+const string kCursorExpression = "[line('.'), col('.'), getreg('%')]";
+//the full mode, for the prompts that can't be left
+const string kModeExpression = "mode(1)";
 
-string GetCursorCommand(const string& serverName, const Location& location,
-    char delim = '>') {
-  return ExprPrefix(serverName) + 
-    SingleQuote("cursor(" + to_string(location.line) + ", " + 
-        to_string(location.column) + ")");
+string GetHighlightPatternExpression(const string& pattern) {
+  return "matchadd('reverse', " + VimString(pattern) + ")";
 }
 
-string GetFileNameCommand(const string& serverName, char delim = '>') {
-  return ExprPrefix(serverName) + 
-    SingleQuote("getreg(\"%\") . " + QuoteDelim(delim));
-}
-
-string GetHighlightPatternCommand(const string& serverName, 
-    const string& pattern, char delim = '>') {
-  return ExprPrefix(serverName) + 
-    SingleQuote("matchadd(\"reverse\", \"" + 
-        pattern + "\") . " + QuoteDelim(delim));
-}
-
-string GetHighlightRangeCommand(const string& serverName, 
-    const Range& range, char delim = '>') {
+string GetHighlightRangeExpression(const Range& range) {
   string rangeString = "[" + JoinList(MakeStringList(range.Lines()), ',') + "]";
-  //cout << "rangestring: " << rangeString << endl;
-  return ExprPrefix(serverName) + 
-    SingleQuote("matchaddpos(\"reverse\"," + 
-        rangeString + ") . " + QuoteDelim(delim));
-}
-
-string GetLineCommand(const string& serverName, char delim = '>') {
-  return ExprPrefix(serverName) + 
-    SingleQuote("line(\".\") . " + QuoteDelim(delim));
-}
-
-string GetLocListCommand(const string& serverName, const string& locationList,
-    char delim = '>') {
-  return ExprPrefix(serverName) + 
-    SingleQuote("setloclist(0," + locationList + ") . " + QuoteDelim(delim));
-}
-
-string GetModeCommand(const string& serverName, char delim = '>') {
-  return ExprPrefix(serverName) 
-    + SingleQuote("mode(\".\") . " + QuoteDelim(delim));
-}
-
-string GetRedrawCommand(const string& serverName, char delim = '>') {
-  return SendPrefix(serverName) 
-    + SingleQuote(":redraw<Enter>");
+  return "matchaddpos('reverse', " + rangeString + ")";
 }
 
-string GetSetNormalCommand(const string& serverName, char delim = '>') {
-  return SendPrefix(serverName) 
-    + SingleQuote("<C-\\><C-N>");
-}
-
-string GetUnHighlightCommand(const string& serverName, 
-    size_t id, char delim = '>') {
-  return ExprPrefix(serverName) + 
-    SingleQuote((string)"matchdelete(" + to_string(id) + ")");
+/*
+ * vim is told where to connect through the environment, since the name of
+ * the socket would have to be quoted for both the shell and vim otherwise.
+ * The channel is kept in a global, or vim would close it again.
+ */
+string DefaultEditor(const string& serverName) {
+  return "gvim --servername " + serverName +
+    " -c 'let g:harmonogram = ch_open(\"unix:\" . $" + kChannelVariable +
+    ", {\"mode\": \"json\"})'";
 }
 
 //here is what I set whenever I open vim.  It may be intrusive to some...
@@ -139,61 +76,19 @@ const list<string> kDefaultSettings {
   "textwidth=80"
 };
 
-string GetInitialOptionsCommand(const string& serverName, char delim = '>') {
-  return SendPrefix(serverName) + SingleQuote(
-          kColorScheme + kEnter + 
-          kSet + JoinList(kDefaultSettings) + kEnter + 
-          kReverseHighlightGroup + kEnter +
-          kSetReg + kRegL + kEnter + 
-          kSetReg + kRegH + kEnter +
-          kSet + kWindowSize + kEnter);
+list<string> InitialOptions() {
+  return {kColorScheme,
+          kSet + JoinList(kDefaultSettings),
+          kReverseHighlightGroup,
+          kSetReg + kRegL,
+          kSetReg + kRegH,
+          kSet + kWindowSize};
 }
 
 //
 
-/*
- * Poll the file at $fileName until the delimiter is found.  The intention is
- * that the existence of the delimiter implies that the vimserver has fully
- * communicated its response, but there is a timeout just in case.
- */
-bool GotResponse(const string& fileName, string& response, 
-    char delim, double timeout) {
-  cout << __func__ << endl;
-  double timeDelta = timeout / 20;
-  ifstream file(fileName);
-  //cout << "response file: " << fileName << endl;
-
-  for (double wait = 0; wait < timeout; wait += timeDelta) {
-    getline(file, response, delim);
-    if (file.eof()) {
-      file.seekg(0);
-      cout << delim << " wasn't found in: " << response << endl;
-      MySystemCall("sleep .1s");
-      continue;
-    } else {
-      cout << "response: " << response << endl;
-      return true;
-    }
-  }
-  return false;
-}
-
-string GetServerListCommand() {
-  return "echo `gvim --serverlist` \">\" ";
-}
-
-/*
- * Return a list of active servers
- */
-list<string> ServerList(double timeout) {
-  list<string> serverList;
-  GetValueFromVimServer<list<string>>(GetServerListCommand(), serverList, '>', timeout);
-  cout << "serverList: " << endl;
-  for (const auto& s : serverList) cout << s << endl;
-  return serverList;
-}
-
-VimServer::VimServer(const string& name) : name_(name) {}
+VimServer::VimServer(const string& name, const string& editor)
+  : setNormal(false), name_(name), editor_(editor), active_(false) {}
 
 bool VimServer::Activate() {
   cout << __func__ << endl;
@@ -202,24 +97,14 @@ bool VimServer::Activate() {
   return RefreshServer(1);
 }
 
-bool CaseInsensitiveEqual(const string l, const string r) {
-  if (l.size() != r.size()) return false;
-  size_t max = l.size();
-  for (size_t i = 0; i < max; ++i) {
-    if (tolower(l[i]) != tolower(r[i])) return false;
-  }
-  return true;
-}
-
+//the editor is there if it answers
 bool VimServer::CheckServer(double timeout) {
   cout << __func__ << ", " << name_ << endl;
-  for (const auto& server : ServerList(timeout)) {
-    cout << "checking: " << server << endl;
-    if (CaseInsensitiveEqual(name_,server)) {
-      cout << name_ << " active!" << endl;
-      active_ = true;
-      return true;
-    }
+  int one = 0;
+  if (channel_.Connected() && Query<int>("1", one, timeout) && one == 1) {
+    cout << name_ << " active!" << endl;
+    active_ = true;
+    return true;
   }
   cout << name_ << " not active!" << endl;
   active_ = false;
@@ -228,7 +113,8 @@ bool VimServer::CheckServer(double timeout) {
 
 bool VimServer::Exit() {
   if (SetNormalMode()) {
-    MySystemCall(GetExitCommand(GetName()).c_str());
+    channel_.Ex("xa");
+    channel_.Close();
     active_ = false;
     return true;
   } else {
@@ -236,71 +122,109 @@ bool VimServer::Exit() {
   }
 }
 
+//vim has the line and column, which are turned back into an offset
 bool VimServer::GetCursor(Location& location) {
-  if (GetValueFromVimServer<size_t>(
-          GetLineCommand(name_), location.line) &&
-
-      GetValueFromVimServer<size_t>(
-          GetColCommand(name_), location.column) &&
-
-      GetValueFromVimServer<string>(
-          GetFileNameCommand(name_), location.fileName)
-      ) return true;
+  JsonValue cursor;
+  if (channel_.Expr(kCursorExpression, cursor) &&
+      cursor.items.size() == 3) {
+    size_t line = strtoul(cursor.items[0].text.c_str(), nullptr, 10);
+    size_t column = strtoul(cursor.items[1].text.c_str(), nullptr, 10);
+    location.file = Sources().Find(cursor.items[2].text);
+    location.offset = Sources().Offset(location.file, line, column);
+    return location.Valid();
+  }
   return false;
 }
 
+/*
+ * The highlights are added and deleted in one EditorBatch, with one redraw
+ * for all of them, so any number of them is one round trip (or none, if
+ * there are only deletes).  Those that are already there, or already gone,
+ * are left out.  Patterns and ranges are kept apart, in highlightIdMap and
+ * rangeIdMap_.
+ */
+template<typename Key>
+bool VimServer::ChangeHighlights(map<Key, HighlighId>& ids,
+    const list<pair<Key, string>>& add, const list<Key>& remove) {
+  EditorBatch batch;
+  for (const Key& key : remove) {
+    auto highlight = ids.find(key);
+    if (highlight == ids.end()) continue;
+    batch.Ex("call matchdelete(" + to_string(highlight->second) + ")");
+  }
+  //(key, where its id will be in the results)
+  list<pair<Key, size_t>> added;
+  for (const auto& highlight : add) {
+    if (ids.count(highlight.first)) continue;
+    added.emplace_back(highlight.first, batch.Expr(highlight.second));
+  }
+  if (batch.empty()) return true;
+  batch.Redraw();
+  JsonValue results;
+  if (!channel_.Run(batch, results)) return false;
+  //an answer that doesn't match the batch changes nothing here
+  for (const auto& highlight : added) {
+    if (highlight.second >= results.items.size() ||
+        results.items[highlight.second].kind != JsonValue::kNumber) {
+      return false;
+    }
+  }
+  for (const Key& key : remove) ids.erase(key);
+  for (const auto& highlight : added) {
+    ids[highlight.first] =
+        strtoul(results.items[highlight.second].text.c_str(), nullptr, 10);
+  }
+  return true;
+}
+
 bool VimServer::HighlightPattern(const string& pattern) {
-  if (highlightIdMap.count(pattern)) return true;
-  HighlighId highlightId;
-  if (GetValueFromVimServer<HighlighId>(
-      GetHighlightPatternCommand(name_, pattern), highlightId)) {
-    highlightIdMap[pattern] = highlightId;
-    Redraw();
-    return true;
-  } 
-  return false;
+  return ChangeHighlights<string>(highlightIdMap,
+      {{pattern, GetHighlightPatternExpression(pattern)}}, {});
+}
+
+bool VimServer::HighlightPatterns(const list<string>& highlight,
+    const list<string>& unhighlight) {
+  list<pair<string, string>> add;
+  for (const string& pattern : highlight) {
+    add.emplace_back(pattern, GetHighlightPatternExpression(pattern));
+  }
+  return ChangeHighlights(highlightIdMap, add, unhighlight);
 }
 
 bool VimServer::HighlightRange(const Range& range) {
-  if (highlightIdMap.count(range.ToString())) return true;
-  HighlighId highlightId;
-  if (GetValueFromVimServer<HighlighId>(
-      GetHighlightRangeCommand(name_, range), highlightId)) {
-    highlightIdMap[range.ToString()] = highlightId;
-    Redraw();
-    return true;
-  } 
-  return false;
+  return ChangeHighlights<Range>(rangeIdMap_,
+      {{range, GetHighlightRangeExpression(range)}}, {});
 }
 
+//the channel's redraw works in any mode
 bool VimServer::Redraw() {
-  if (SetNormalMode()) {
-    MySystemCall(GetRedrawCommand(name_));
-    return true;
-  }
-  return false;
+  return channel_.Redraw();
 }
 
 bool VimServer::RefreshServer(double timeout) {
   if (!active_) return false;
   cout << __func__ << endl;
   //see if anything needs to be done...
+  if (CheckServer(timeout)) return true;
 
-  //start up the server...
-  //char c;
-  //cout << "press y to open new server" << endl;
-  //cin >> c;
-  //if (c != 'y') return false;
-  string command = "gvim --servername " + name_ + " " 
-    + JoinList(fileNameList_);
-  MySystemCall(command.c_str());
+  //start up the editor, which connects back to the channel
+  string path = "/tmp/" + name_ + "." + to_string(getpid()) + ".sock";
+  if (!channel_.Listen(path)) {
+    cout << "couldn't listen on: " << path << endl;
+    return false;
+  }
+  setenv(kChannelVariable, path.c_str(), 1);
+  string editor = editor_.empty() ? DefaultEditor(name_) : editor_;
+  MySystemCall(editor + " " + JoinList(fileNameList_) + " &");
 
   //wait for it...
-  MySystemCall("sleep 1s");
+  if (!channel_.Accept(kStartupTimeout)) {
+    cout << "the editor didn't connect to: " << path << endl;
+    return false;
+  }
 
   //set some default options
-  cout << "initial options: " << GetInitialOptionsCommand(name_) << endl;
-  MySystemCall(GetInitialOptionsCommand(name_).c_str());
+  for (const string& option : InitialOptions()) channel_.Ex(option);
 
   //check to make sure it is freakin open now...
   return (CheckServer());
@@ -308,9 +232,9 @@ bool VimServer::RefreshServer(double timeout) {
 
 bool VimServer::SetCursor(const Location& location) {
   if (SetNormalMode()) {
-    MySystemCall(GetEditFileCommand(name_, location.fileName).c_str());
-    MySystemCall(GetCursorCommand(name_, location).c_str());
-    return true;
+    return channel_.Ex("edit " + location.FileName() + " | call cursor(" +
+        to_string(location.Line()) + ", " + to_string(location.Column()) +
+        ")");
   }
   return false;
 }
@@ -319,21 +243,38 @@ void VimServer::SetFileNameList(const list<string>& fileNameList) {
   fileNameList_ = fileNameList;
 }
 
+/*
+ * Both rangeIdMap_ and ranges are sorted, so one pass over the two finds the
+ * ones to delete (only in rangeIdMap_) and to add (only in ranges); those in
+ * both are left as they are.
+ */
+bool VimServer::SetHighlightedRanges(const set<Range>& ranges) {
+  list<pair<Range, string>> add;
+  list<Range> remove;
+  auto highlighted = rangeIdMap_.begin();
+  auto wanted = ranges.begin();
+  while (highlighted != rangeIdMap_.end() || wanted != ranges.end()) {
+    if (wanted == ranges.end() ||
+        (highlighted != rangeIdMap_.end() && highlighted->first < *wanted)) {
+      remove.push_back((highlighted++)->first);
+    } else if (highlighted == rangeIdMap_.end() ||
+        *wanted < highlighted->first) {
+      add.emplace_back(*wanted, GetHighlightRangeExpression(*wanted));
+      ++wanted;
+    } else {
+      ++highlighted;
+      ++wanted;
+    }
+  }
+  return ChangeHighlights(rangeIdMap_, add, remove);
+}
+
 bool VimServer::UnHighlightPattern(const string& pattern) {
-  if (!highlightIdMap.count(pattern)) return true;
-  MySystemCall(GetUnHighlightCommand(name_, highlightIdMap[pattern]).c_str());
-  highlightIdMap.erase(pattern);
-  Redraw();
-  return true;
+  return ChangeHighlights<string>(highlightIdMap, {}, {pattern});
 }
 
 bool VimServer::UnHighlightRange(const Range& range) {
-  string rangeString = range.ToString();
-  if (!highlightIdMap.count(rangeString)) return true;
-  MySystemCall(GetUnHighlightCommand(name_, highlightIdMap[rangeString]).c_str());
-  highlightIdMap.erase(rangeString);
-  Redraw();
-  return true;
+  return ChangeHighlights<Range>(rangeIdMap_, {}, {range});
 }
 
 VimServer::~VimServer() { Exit(); }
@@ -344,8 +285,8 @@ VimServer::~VimServer() { Exit(); }
  * :help dictionaries
  */
 string GetDictionary(const Range& range) {
-  return "{\"filename\":\"" + range.begin.fileName + "\", \"lnum\":" + 
-    to_string(range.begin.line) + ", \"col\":" + to_string(range.begin.column) + "}";
+  return "{\"filename\":\"" + range.begin.FileName() + "\", \"lnum\":" + 
+    to_string(range.begin.Line()) + ", \"col\":" + to_string(range.begin.Column()) + "}";
 }
 
 /*
@@ -376,13 +317,13 @@ bool CanSwitchToNormalFrom(const string& curMode) {
           curMode != kModeShell);
 }
 
+//CTRL-\ CTRL-N, typed as if by the user, as --remote-send did
 bool VimServer::SetNormalMode() {
   if (setNormal) return true;
   string curMode;
-  GetValueFromVimServer<string>(GetModeCommand(name_), curMode);
+  if (!Query<string>(kModeExpression, curMode)) return false;
   if (CanSwitchToNormalFrom(curMode)) {
-    MySystemCall(GetSetNormalCommand(name_).c_str());
-    return true;
+    return channel_.Ex("call feedkeys(\"\\x1c\\x0e\", \"n\")");
   }
   return false;
 }
@@ -393,48 +334,19 @@ void MySystemCall(const string& command) {
   system(command.c_str());
 }
 
-template<>
-bool GetValueFromVimServer<list<string>>(const string& command, list<string>& out,
-    char delim, double timeout) {
-  string response;
-  string responseFileName(".response_" + 
-      std::to_string(++VimServer::fileId));
-
-  string myCommand = command + " > " + responseFileName;
-  std::cout << "STRING LIST Executing: \n" << myCommand << std::endl;
-  MySystemCall(myCommand.c_str());
-
-  if (GotResponse(responseFileName, response, delim, timeout)) {
-    cout << "got response!" << response << endl;
-    std::istringstream iss(response);
-    string tmp;
-    while (iss.good()) {
-      iss >> tmp;
-      cout << "read:" << tmp << endl;
-      out.push_back(move(tmp));
-    }
-    //MySystemCall(string("rm " + responseFileName).c_str());
-    return true;
-  } else {
-    std::cout << "No Response!" << std::endl;
-    return false;
-  }
-}
-
 }; //namespace vimserverNames
 
 
 /*
 using namespace vimserverNames;
 int main() {
-  Location l1{"servertesting",5,2};
-  Location l2{"servertesting",7,2};
-  Range r1{l1, l2};
+  FileId file = Sources().Register("servertesting");
+  Range r1{Location{file, Sources().Offset(file, 5, 2)},
+           Location{file, Sources().Offset(file, 7, 2)}};
 
   VimServer server("FOO");
   server.SetFileNameList({"servertesting"});
   cout << "activate: " << server.Activate() << endl;
-  cout << "server list:\n" << JoinList(ServerList()) << endl;
   cout << "HighlightRange: " << server.HighlightRange(r1) << endl;
   char c;
   cout << "press any key to set cursor" << endl;